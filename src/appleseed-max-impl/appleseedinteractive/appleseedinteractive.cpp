@@ -38,6 +38,12 @@
 // appleseed-max-common headers.
 #include "appleseed-max-common/iappleseedmtl.h"
 
+// appleseed.renderer headers.
+#include "renderer/api/log.h"
+
+// appleseed.foundation headers.
+#include "foundation/platform/windows.h"
+
 // Boost headers.
 #include "boost/thread/locks.hpp"
 #include "boost/thread/mutex.hpp"
@@ -46,19 +52,165 @@
 #include "appleseed-max-common/_beginmaxheaders.h"
 #include <assert1.h>
 #include <matrix3.h>
+#include <notify.h>
+#include <renderelements.h>
 #include "appleseed-max-common/_endmaxheaders.h"
 
+// Windows headers.
+#include <psapi.h>
+
 // Standard headers.
+#include <algorithm>
 #include <clocale>
+#include <cmath>
+#include <sstream>
 
 namespace asf = foundation;
 namespace asr = renderer;
 
+
+//
+// Records whether the 3ds Max entities a session was built from changed, without keeping them alive.
+//
+
+class SceneInputsWatcher
+  : public ReferenceMaker
+{
+  public:
+    explicit SceneInputsWatcher(const std::vector<ReferenceTarget*>& targets)
+      : m_targets(targets.size(), nullptr)
+      , m_changed(false)
+    {
+        for (size_t i = 0, e = targets.size(); i < e; ++i)
+            ReplaceReference(static_cast<int>(i), targets[i]);
+    }
+
+    ~SceneInputsWatcher() override
+    {
+        DeleteAllRefsFromMe();
+    }
+
+    bool has_changed() const
+    {
+        return m_changed;
+    }
+
+    int NumRefs() override
+    {
+        return static_cast<int>(m_targets.size());
+    }
+
+    RefTargetHandle GetReference(int i) override
+    {
+        return m_targets[i];
+    }
+
+    BOOL IsRealDependency(ReferenceTarget* rtarg) override
+    {
+        return FALSE;
+    }
+
+    RefResult NotifyRefChanged(
+        const Interval&                 changeInt,
+        RefTargetHandle                 hTarget,
+        PartID&                         partID,
+        RefMessage                      message,
+        BOOL                            propagate) override
+    {
+        switch (message)
+        {
+          case REFMSG_CHANGE:
+          case REFMSG_SUBANIM_STRUCTURE_CHANGED:
+          case REFMSG_TARGET_DELETED:
+            m_changed = true;
+            break;
+        }
+
+        return REF_DONTCARE;
+    }
+
+  protected:
+    void SetReference(int i, RefTargetHandle rtarg) override
+    {
+        m_targets[i] = rtarg;
+    }
+
+  private:
+    std::vector<ReferenceTarget*>       m_targets;
+    bool                                m_changed;
+};
+
 namespace
 {
     boost::mutex                g_current_interactive_mutex;
     AppleseedInteractiveRender* g_current_interactive;
 
+    // Return a description of the scene-level inputs of project building that scene change callbacks don't track.
+    std::string get_scene_inputs(const RendererSettings& settings, const TimeValue time)
+    {
+        std::stringstream sstr;
+
+        sstr << settings.m_background_alpha << ' '
+             << settings.m_background_emits_light << ' '
+             << settings.m_force_off_default_lights << ' '
+             << settings.m_enable_override_material << ' '
+             << settings.m_override_exclude_light_materials << ' '
+             << settings.m_override_exclude_glass_materials << ' '
+             << settings.m_override_material << ' '
+             << settings.m_scale_multiplier << ' '
+             << settings.m_use_max_procedural_maps << ' ';
+
+        Interface* max_interface = GetCOREInterface();
+        const Point3 background = max_interface->GetBackGround(time, FOREVER);
+        sstr << max_interface->GetUseEnvironmentMap() << ' '
+             << max_interface->GetEnvironmentMap() << ' '
+             << background.x << ' ' << background.y << ' ' << background.z << ' ';
+
+        IRenderElementMgr* re_manager = max_interface->GetCurRenderElementMgr();
+        if (re_manager != nullptr)
+        {
+            for (int i = 0, e = re_manager->NumRenderElements(); i < e; ++i)
+                sstr << re_manager->GetRenderElement(i) << ' ';
+        }
+
+        return sstr.str();
+    }
+
+    // Return the entities whose parameters affect project building but whose changes scene change callbacks don't report.
+    std::vector<ReferenceTarget*> get_scene_input_entities(const RendererSettings& settings)
+    {
+        std::vector<ReferenceTarget*> entities;
+
+        Interface* max_interface = GetCOREInterface();
+        if (max_interface->GetEnvironmentMap() != nullptr)
+            entities.push_back(max_interface->GetEnvironmentMap());
+
+        if (settings.m_override_material != nullptr)
+            entities.push_back(settings.m_override_material);
+
+        IRenderElementMgr* re_manager = max_interface->GetCurRenderElementMgr();
+        if (re_manager != nullptr)
+        {
+            for (int i = 0, e = re_manager->NumRenderElements(); i < e; ++i)
+                entities.push_back(re_manager->GetRenderElement(i));
+        }
+
+        return entities;
+    }
+
+    // Return the amount of memory privately allocated by the process.
+    size_t get_process_private_bytes()
+    {
+        PROCESS_MEMORY_COUNTERS_EX counters;
+        if (!GetProcessMemoryInfo(
+                GetCurrentProcess(),
+                reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters),
+                sizeof(counters)))
+            return 0;
+
+        return counters.PrivateUsage;
+    }
+
     void get_view_params_from_viewport(
         ViewParams&             view_params,
         ViewExp&                view_exp,
@@ -214,6 +366,7 @@ namespace
                 return;
 
             std::vector<INode*> updated_nodes;
+            std::vector<INode*> updated_lights;
             for (int i = 0, e = nodes.Count(); i < e; ++i)
             {
                 INode* node = NodeEventNamespace::GetNodeByKey(nodes[i]);
@@ -233,11 +386,12 @@ namespace
 
                 if (os.obj && os.obj->SuperClassID() == LIGHT_CLASS_ID)
                 {
-                    // TODO: update lights here
+                    updated_lights.push_back(node);
                 }
             }
 
             m_renderer->update_object_instance(updated_nodes);
+            m_renderer->update_light(updated_lights);
             m_renderer->get_render_session()->reininitialize_render();
         }
         
@@ -276,6 +430,7 @@ namespace
         void ControllerOtherEvent(NodeKeyTab& nodes) override 
         {
             std::vector<INode*> transformed_nodes;
+            std::vector<INode*> transformed_lights;
             for (int i = 0, e = nodes.Count(); i < e; ++i)
             {
                 INode* node = NodeEventNamespace::GetNodeByKey(nodes[i]);
@@ -284,14 +439,21 @@ namespace
                 {
                     transformed_nodes.push_back(node);
                 }
+
+                if (os.obj && os.obj->SuperClassID() == LIGHT_CLASS_ID)
+                {
+                    transformed_lights.push_back(node);
+                }
             }
-            m_renderer->update_object_instance(transformed_nodes);
+            m_renderer->update_object_transform(transformed_nodes);
+            m_renderer->update_light(transformed_lights);
             m_renderer->get_render_session()->reininitialize_render();
         }
 
         void Added(NodeKeyTab& nodes) override 
         {
             std::vector<INode*> added_nodes;
+            std::vector<INode*> added_lights;
             for (int i = 0, e = nodes.Count(); i < e; ++i)
             {
                 INode* node = NodeEventNamespace::GetNodeByKey(nodes[i]);
@@ -300,8 +462,14 @@ namespace
                 {
                     added_nodes.push_back(node);
                 }
+
+                if (os.obj && os.obj->SuperClassID() == LIGHT_CLASS_ID)
+                {
+                    added_lights.push_back(node);
+                }
             }
             m_renderer->add_object_instance(added_nodes);
+            m_renderer->add_light(added_lights);
             m_renderer->get_render_session()->reininitialize_render();
         }
 
@@ -313,6 +481,7 @@ namespace
                 removed_nodes.push_back(NodeEventNamespace::GetNodeByKey(nodes[i]));
             }
             m_renderer->remove_object_instance(removed_nodes);
+            m_renderer->remove_light(removed_nodes);
             m_renderer->get_render_session()->reininitialize_render();
         }
 
@@ -322,6 +491,49 @@ namespace
         INode*                              m_active_camera;
     };
 
+    // Only accessed from the UI thread.
+    bool g_view_change_pending = false;
+    bool g_pending_view_change_is_small = false;
+
+    // Return true if two views are close enough for the change to wait for the end of the current pass.
+    bool is_small_view_change(
+        const Matrix3&      lhs_mat,
+        const float         lhs_fov,
+        const Matrix3&      rhs_mat,
+        const float         rhs_fov)
+    {
+        const float RotationThreshold = 0.01f;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (Length(lhs_mat.GetRow(i) - rhs_mat.GetRow(i)) > RotationThreshold)
+                return false;
+        }
+
+        const float TranslationThreshold = 0.01f * std::max(Length(lhs_mat.GetTrans()), 1.0f);
+        if (Length(lhs_mat.GetTrans() - rhs_mat.GetTrans()) > TranslationThreshold)
+            return false;
+
+        const float FovThreshold = 0.01f * std::abs(lhs_fov);
+        return std::abs(lhs_fov - rhs_fov) <= FovThreshold;
+    }
+
+    // Return the delay after which camera changes are applied, in milliseconds.
+    UINT get_camera_update_delay(InteractiveSession* session)
+    {
+        const double DefaultDelay = 100.0;
+        const double MinDelay = 10.0;
+        const double MaxDelay = 500.0;
+
+        // Wait about as long as the scene needs to produce a first pass.
+        const double time_to_first_frame_update = session->get_time_to_first_frame_update();
+        const double delay =
+            time_to_first_frame_update < 0.0
+                ? DefaultDelay
+                : std::min(std::max(time_to_first_frame_update, MinDelay), MaxDelay);
+
+        return static_cast<UINT>(delay);
+    }
+
     class ViewportCallback 
       : public RedrawViewsCallback
     {
@@ -330,9 +542,12 @@ namespace
           : m_current_view(nullptr)
           , m_last_fov(0.0f)
           , m_last_timer(0)
+          , m_applied_fov(0.0f)
           , m_max_hwnd(GetCOREInterface()->GetMAXHWnd())
+          , m_preview_divisor(std::max(load_system_setting(L"ActiveShadePreviewDivisor", 4), 1))
         {
             m_last_mat.IdentityMatrix();
+            m_applied_mat.IdentityMatrix();
 
             GetCOREInterface()->RegisterRedrawViewsCallback(this);
         }
@@ -354,10 +569,24 @@ namespace
                 boost::mutex::scoped_lock lock(g_current_interactive_mutex);
                 if (g_current_interactive != nullptr)
                 {
+                    // The camera stopped moving, render at full resolution.
                     g_current_interactive->update_render_view();
-                    g_current_interactive->get_render_session()->reininitialize_render();
+
+                    if (g_pending_view_change_is_small)
+                    {
+                        // Let the current pass complete rather than throwing it away.
+                        g_current_interactive->get_render_session()->reininitialize_render_after_frame_update();
+                    }
+                    else
+                    {
+                        g_current_interactive->get_render_session()->schedule_frame_resolution_update(1);
+                        g_current_interactive->get_render_session()->reininitialize_render();
+                    }
                 }
             }
+
+            g_view_change_pending = false;
+            g_pending_view_change_is_small = false;
         }
 
         void proc(Interface* ip) override
@@ -377,12 +606,47 @@ namespace
                 if (m_last_mat != curr_mat ||
                     m_last_fov != curr_fov)
                 {
+                    // The render was last restarted with the view seen before the first pending change.
+                    if (!g_view_change_pending)
+                    {
+                        m_applied_mat = m_last_mat;
+                        m_applied_fov = m_last_fov;
+                    }
+
+                    // Small changes since the last applied view don't need to interrupt the current pass.
+                    const bool small_change =
+                        (!g_view_change_pending || g_pending_view_change_is_small) &&
+                        is_small_view_change(m_applied_mat, m_applied_fov, curr_mat, curr_fov);
+
                     m_last_mat = curr_mat;
                     m_last_fov = curr_fov;
+
+                    boost::mutex::scoped_lock lock(g_current_interactive_mutex);
+                    if (g_current_interactive == nullptr)
+                        return;
+
+                    // Give immediate feedback at a lower resolution while the camera is moving.
+                    if (!small_change && m_preview_divisor > 1)
+                    {
+                        g_current_interactive->update_render_view();
+                        g_current_interactive->get_render_session()->schedule_frame_resolution_update(static_cast<size_t>(m_preview_divisor));
+                        g_current_interactive->get_render_session()->reininitialize_render();
+                    }
+
+                    g_view_change_pending = true;
+                    g_pending_view_change_is_small = small_change;
+
+                    if (!small_change)
+                    {
+                        m_applied_mat = curr_mat;
+                        m_applied_fov = curr_fov;
+                    }
+
+                    const UINT delay = get_camera_update_delay(g_current_interactive->get_render_session());
                     if (m_last_timer == 0)
-                        m_last_timer = SetTimer(m_max_hwnd, 0, 100, timer_proc);
+                        m_last_timer = SetTimer(m_max_hwnd, 0, delay, timer_proc);
                     else
-                        SetTimer(m_max_hwnd, m_last_timer, 100, timer_proc);
+                        SetTimer(m_max_hwnd, m_last_timer, delay, timer_proc);
                 }
             }
         }
@@ -391,8 +655,11 @@ namespace
         ViewExp*    m_current_view;
         float       m_last_fov;
         Matrix3     m_last_mat;
+        float       m_applied_fov;          // view the render was last restarted with
+        Matrix3     m_applied_mat;
         UINT_PTR    m_last_timer;
         HWND        m_max_hwnd;
+        const int   m_preview_divisor;      // resolution divisor while the camera is moving, 1 to disable
     };
 }
 
@@ -410,14 +677,26 @@ AppleseedInteractiveRender::AppleseedInteractiveRender()
   , m_view_inode(nullptr)
   , m_view_exp(nullptr)
   , m_progress_cb(nullptr)
+  , m_memory_before_session(0)
+  , m_time(0)
 {
     m_entities.clear();
+
+    // The previous session can't be resumed once the scene is replaced.
+    RegisterNotification(&AppleseedInteractiveRender::on_scene_reset, this, NOTIFY_SYSTEM_PRE_RESET);
+    RegisterNotification(&AppleseedInteractiveRender::on_scene_reset, this, NOTIFY_SYSTEM_PRE_NEW);
+    RegisterNotification(&AppleseedInteractiveRender::on_scene_reset, this, NOTIFY_FILE_PRE_OPEN);
 }
 
 AppleseedInteractiveRender::~AppleseedInteractiveRender()
 {
+    UnRegisterNotification(&AppleseedInteractiveRender::on_scene_reset, this, NOTIFY_SYSTEM_PRE_RESET);
+    UnRegisterNotification(&AppleseedInteractiveRender::on_scene_reset, this, NOTIFY_SYSTEM_PRE_NEW);
+    UnRegisterNotification(&AppleseedInteractiveRender::on_scene_reset, this, NOTIFY_FILE_PRE_OPEN);
+
     // Make sure the ActiveShade session has stopped.
     EndSession();
+    discard_parked_session();
 }
 
 asf::auto_release_ptr<asr::Project> AppleseedInteractiveRender::prepare_project(
@@ -469,8 +748,10 @@ asf::auto_release_ptr<asr::Project> AppleseedInteractiveRender::prepare_project(
             get_render_session()->m_object_map,
             get_render_session()->m_object_inst_map,
             get_render_session()->m_material_map,
+            get_render_session()->m_light_emitting_mtl_map,
             get_render_session()->m_assembly_map,
-            get_render_session()->m_assembly_inst_map));
+            get_render_session()->m_assembly_inst_map,
+            get_render_session()->m_light_map));
 
     std::setlocale(LC_ALL, previous_locale.c_str());
 
@@ -494,6 +775,26 @@ void AppleseedInteractiveRender::update_object_instance(const std::vector<INode*
     get_render_session()->schedule_udpate_object_instance(nodes);
 }
 
+void AppleseedInteractiveRender::update_object_transform(const std::vector<INode*>& nodes)
+{
+    get_render_session()->schedule_transform_update(nodes);
+}
+
+void AppleseedInteractiveRender::add_light(const std::vector<INode*>& nodes)
+{
+    get_render_session()->schedule_add_light(nodes);
+}
+
+void AppleseedInteractiveRender::remove_light(const std::vector<INode*>& nodes)
+{
+    get_render_session()->schedule_remove_light(nodes);
+}
+
+void AppleseedInteractiveRender::update_light(const std::vector<INode*>& nodes)
+{
+    get_render_session()->schedule_update_light(nodes);
+}
+
 void AppleseedInteractiveRender::update_material(const std::vector<INode*>& nodes)
 {
     std::vector<Mtl*> materials;
@@ -526,7 +827,7 @@ void AppleseedInteractiveRender::update_material(const std::vector<INode*>& node
         if (appleseed_mtl == nullptr)
             continue;
 
-        if (get_render_session()->m_material_map.count(mtl) > 0)
+        if (get_render_session()->m_material_map.count(mtl) == 0)
             continue;
         updated_materials[appleseed_mtl] = get_render_session()->m_material_map[mtl];
     }
@@ -568,13 +869,47 @@ void AppleseedInteractiveRender::update_render_view()
 
 InteractiveSession* AppleseedInteractiveRender::get_render_session()
 {
-    return m_render_session.get();
+    // While a session is parked, scene changes keep being recorded into it.
+    return m_render_session != nullptr ? m_render_session.get() : m_parked_session.get();
+}
+
+bool AppleseedInteractiveRender::can_park_session() const
+{
+    // Memory budget in MB, 0 disables warm restarts.
+    const int budget = load_system_setting(L"ActiveShadeWarmRestartBudget", 2048);
+    if (budget <= 0)
+        return false;
+
+    const size_t memory = get_process_private_bytes();
+    const size_t footprint = memory > m_memory_before_session ? memory - m_memory_before_session : 0;
+
+    return footprint <= static_cast<size_t>(budget) * 1024 * 1024;
+}
+
+void AppleseedInteractiveRender::discard_parked_session()
+{
+    if (m_parked_session == nullptr)
+        return;
+
+    m_node_callback.reset(nullptr);
+    m_parked_session.reset(nullptr);
+    m_scene_inputs_watcher.reset(nullptr);
+    m_project.reset();
+}
+
+void AppleseedInteractiveRender::on_scene_reset(void* param, NotifyInfo* info)
+{
+    static_cast<AppleseedInteractiveRender*>(param)->discard_parked_session();
 }
 
 void AppleseedInteractiveRender::BeginSession()
 {
     DbgAssert(m_render_session == nullptr);
-    
+
+    // Objects of the previous session were evaluated at another time.
+    if (m_time != GetCOREInterface()->GetTime())
+        discard_parked_session();
+
     m_time = GetCOREInterface()->GetTime();
 
     ViewExp13* vp13 = reinterpret_cast<ViewExp13*>(GetViewExp()->Execute(ViewExp::kEXECUTE_GET_VIEWEXP_13));
@@ -592,13 +927,46 @@ void AppleseedInteractiveRender::BeginSession()
     
     RendererSettings renderer_settings = appleseed_renderer->get_renderer_settings();
     renderer_settings.m_output_mode = RendererSettings::OutputMode::RenderOnly;
-    
-    m_render_session.reset(new InteractiveSession(
-        m_irender_manager,
-        renderer_settings,
-        m_bitmap));
+    renderer_settings.m_enable_checkpoint = false;
+    renderer_settings.m_resume_from_checkpoint = false;
+
+    // Scene change callbacks don't report changes to the environment, render elements or settings
+    // that affect project building: the previous session is stale if any of them changed.
+    if (m_parked_session != nullptr &&
+        (m_scene_inputs_watcher == nullptr ||
+         m_scene_inputs_watcher->has_changed() ||
+         m_scene_inputs != get_scene_inputs(renderer_settings, m_time)))
+    {
+        RENDERER_LOG_INFO("scene settings changed, discarding previous activeshade session.");
+        discard_parked_session();
+    }
+
+    if (m_parked_session != nullptr)
+    {
+        // Resume the previous session, only the scene changes recorded since it ended need to be applied.
+        RENDERER_LOG_INFO("resuming previous activeshade session.");
+
+        m_render_session = std::move(m_parked_session);
+        m_render_session->resume(m_irender_manager, renderer_settings, m_bitmap);
+        m_render_session->schedule_camera_update(
+            build_camera(active_cam, view_params, m_bitmap, RendererSettings::defaults(), m_time));
+
+        render_begin(m_entities.m_objects, m_time);
+    }
+    else
+    {
+        m_memory_before_session = get_process_private_bytes();
+
+        m_render_session.reset(new InteractiveSession(
+            m_irender_manager,
+            renderer_settings,
+            m_bitmap));
+
+        m_project = prepare_project(renderer_settings, view_params, active_cam, m_time);
 
-    m_project = prepare_project(renderer_settings, view_params, active_cam, m_time);
+        m_scene_inputs = get_scene_inputs(renderer_settings, m_time);
+        m_scene_inputs_watcher.reset(new SceneInputsWatcher(get_scene_input_entities(renderer_settings)));
+    }
 
     if (m_progress_cb)
         m_progress_cb->SetTitle(L"Rendering...");
@@ -608,6 +976,8 @@ void AppleseedInteractiveRender::BeginSession()
         g_current_interactive = this;
     }
 
+    m_render_session->schedule_priority_region_update(m_region);
+
     m_node_callback.reset(new SceneChangeCallback(this, active_cam));
     m_view_callback.reset(new ViewportCallback());
 
@@ -618,7 +988,6 @@ void AppleseedInteractiveRender::EndSession()
 {
     if (m_render_session != nullptr)
     {
-        m_node_callback.reset(nullptr);
         m_view_callback.reset(nullptr);
         m_render_session->abort_render();
         
@@ -637,7 +1006,17 @@ void AppleseedInteractiveRender::EndSession()
 
         m_render_session->end_render();
 
-        m_render_session.reset(nullptr);
+        // Keep the session, its project and acceleration structures around for a warm restart,
+        // and keep recording scene changes into it, unless it uses too much memory.
+        if (can_park_session())
+            m_parked_session = std::move(m_render_session);
+        else
+        {
+            m_node_callback.reset(nullptr);
+            m_render_session.reset(nullptr);
+            m_scene_inputs_watcher.reset(nullptr);
+            m_project.reset();
+        }
 
         const IImageViewer::DisplayStyle display_style = m_irender_manager->GetDisplayStyle();
         if (display_style == IImageViewer::DisplayStyle::IV_FLOATING)
@@ -723,6 +1102,13 @@ ViewExp* AppleseedInteractiveRender::GetViewExp() const
 void AppleseedInteractiveRender::SetRegion(const Box2& region)
 {
     m_region = region;
+
+    // Focus rendering on the new region right away.
+    if (m_render_session != nullptr)
+    {
+        m_render_session->schedule_priority_region_update(m_region);
+        m_render_session->reininitialize_render();
+    }
 }
 
 const Box2& AppleseedInteractiveRender::GetRegion() const
@@ -46,13 +46,16 @@
 #include "appleseed-max-common/_endmaxheaders.h"
 
 // Standard headers.
+#include <cstddef>
 #include <memory>
+#include <string>
 #include <vector>
 
 // Forward declarations.
 namespace renderer { class Project; }
 class InteractiveSession;
 class RendererSettings;
+class SceneInputsWatcher;
 class ViewParams;
 
 class AppleseedInteractiveRender
@@ -99,12 +102,20 @@ class AppleseedInteractiveRender
     void add_object_instance(const std::vector<INode*>&);
     void remove_object_instance(const std::vector<INode*>&);
     void update_object_instance(const std::vector<INode*>&);
+    void update_object_transform(const std::vector<INode*>&);
+    void add_light(const std::vector<INode*>&);
+    void remove_light(const std::vector<INode*>&);
+    void update_light(const std::vector<INode*>&);
     void update_material(const std::vector<INode*>& nodes);
     void update_render_view();
     InteractiveSession* get_render_session();
 
   private:
     std::unique_ptr<InteractiveSession>             m_render_session;
+    std::unique_ptr<InteractiveSession>             m_parked_session;       // previous session, kept for a warm restart
+    size_t                                          m_memory_before_session;
+    std::string                                     m_scene_inputs;         // scene-level inputs the session was built from
+    std::unique_ptr<SceneInputsWatcher>             m_scene_inputs_watcher;
     std::unique_ptr<INodeEventCallback>             m_node_callback;
     std::unique_ptr<RedrawViewsCallback>            m_view_callback;
     foundation::auto_release_ptr<renderer::Project> m_project;
@@ -126,4 +137,9 @@ class AppleseedInteractiveRender
         const ViewParams&           view_params,
         INode*                      camera_node,
         const TimeValue             time);
+
+    bool can_park_session() const;
+    void discard_parked_session();
+
+    static void on_scene_reset(void* param, NotifyInfo* info);
 };
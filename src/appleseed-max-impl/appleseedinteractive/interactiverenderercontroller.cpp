@@ -31,42 +31,172 @@
 
 // appleseed-max headers.
 #include "appleseedinteractive/interactivesession.h"
+#include "appleseedrenderer/materialcache.h"
 #include "utilities.h"
 
+// appleseed.renderer headers.
+#include "renderer/api/log.h"
+#include "renderer/api/material.h"
+
+// appleseed.foundation headers.
+#include "foundation/string/string.h"
+
 // 3ds Max headers.
 #include "appleseed-max-common/_beginmaxheaders.h"
 #include <interactiverender.h>
 #include "appleseed-max-common/_endmaxheaders.h"
 
 // Standard headers.
+#include <algorithm>
 #include <utility>
 
+namespace asf = foundation;
 namespace asr = renderer;
 
+namespace
+{
+    bool is_node_action(const ScheduledAction::Kind kind)
+    {
+        switch (kind)
+        {
+          case ScheduledAction::Kind::AddObjectInstance:
+          case ScheduledAction::Kind::RemoveObjectInstance:
+          case ScheduledAction::Kind::UpdateObjectInstance:
+          case ScheduledAction::Kind::TransformUpdate:
+          case ScheduledAction::Kind::AddLight:
+          case ScheduledAction::Kind::RemoveLight:
+          case ScheduledAction::Kind::UpdateLight:
+            return true;
+
+          default:
+            return false;
+        }
+    }
+
+    enum class Coalescing
+    {
+        KeepBoth,
+        DropPending,        // the pending action is made redundant by the new one
+        DropNew,            // the new action is made redundant by the pending one
+        DropBoth            // the two actions cancel each other out
+    };
+
+    // Decide how a new action targeting a node combines with a pending action targeting the same node.
+    Coalescing get_coalescing(
+        const ScheduledAction::Kind pending_kind,
+        const ScheduledAction::Kind new_kind)
+    {
+        typedef ScheduledAction::Kind Kind;
+
+        switch (new_kind)
+        {
+          case Kind::TransformUpdate:
+            // Adding or rebuilding an instance already picks up its latest transform.
+            if (pending_kind == Kind::TransformUpdate)
+                return Coalescing::DropPending;
+            if (pending_kind == Kind::AddObjectInstance || pending_kind == Kind::UpdateObjectInstance)
+                return Coalescing::DropNew;
+            break;
+
+          case Kind::UpdateObjectInstance:
+            if (pending_kind == Kind::TransformUpdate || pending_kind == Kind::UpdateObjectInstance)
+                return Coalescing::DropPending;
+            if (pending_kind == Kind::AddObjectInstance)
+                return Coalescing::DropNew;
+            break;
+
+          case Kind::RemoveObjectInstance:
+            if (pending_kind == Kind::TransformUpdate || pending_kind == Kind::UpdateObjectInstance)
+                return Coalescing::DropPending;
+            if (pending_kind == Kind::AddObjectInstance)
+                return Coalescing::DropBoth;
+            if (pending_kind == Kind::RemoveObjectInstance)
+                return Coalescing::DropNew;
+            break;
+
+          case Kind::AddObjectInstance:
+            if (pending_kind == Kind::AddObjectInstance)
+                return Coalescing::DropNew;
+            break;
+
+          case Kind::UpdateLight:
+            if (pending_kind == Kind::UpdateLight)
+                return Coalescing::DropPending;
+            if (pending_kind == Kind::AddLight)
+                return Coalescing::DropNew;
+            break;
+
+          case Kind::RemoveLight:
+            if (pending_kind == Kind::UpdateLight)
+                return Coalescing::DropPending;
+            if (pending_kind == Kind::AddLight)
+                return Coalescing::DropBoth;
+            if (pending_kind == Kind::RemoveLight)
+                return Coalescing::DropNew;
+            break;
+
+          case Kind::AddLight:
+            if (pending_kind == Kind::AddLight)
+                return Coalescing::DropNew;
+            break;
+
+          default:
+            break;
+        }
+
+        return Coalescing::KeepBoth;
+    }
+}
+
 void CameraObjectUpdateAction::update()
 {
     m_project.get_scene()->cameras().clear();
     m_project.get_scene()->cameras().insert(m_camera);
 }
 
+void FrameUpdateAction::update()
+{
+    m_project.set_frame(m_frame);
+}
+
+size_t MaterialUpdateAction::merge(const MaterialUpdateAction& other)
+{
+    // Materials of this update take precedence.
+    size_t merged_count = 0;
+    for (const auto& entry : other.m_material_map)
+    {
+        if (!m_material_map.insert(entry).second)
+            ++merged_count;
+    }
+
+    return merged_count;
+}
+
 void MaterialUpdateAction::update()
 {
     renderer::Assembly* assembly = m_project.get_scene()->assemblies().get_by_name("assembly");
     DbgAssert(assembly);
 
+    // Materials may have started or stopped emitting light.
+    m_light_emitting_mtl_map.clear();
+
     for (const auto& mtl : m_material_map)
     {
-        renderer::Material* material = assembly->materials().get_by_name(mtl.second.c_str());
-
-        if (material)
-            assembly->materials().remove(material);
-
-        assembly->materials().insert(
+        // Translate the material aside first: if only shader parameter values changed, patch the live material.
+        asf::auto_release_ptr<asr::Assembly> bundle(
+            asr::AssemblyFactory().create((mtl.second + "_bundle").c_str()));
+        asf::auto_release_ptr<asr::Material> new_material(
             mtl.first->create_material(
-                *assembly,
+                bundle.ref(),
                 mtl.second.c_str(),
                 false,
                 GetCOREInterface()->GetTime()));
+        if (patch_material(*assembly, new_material.ref(), bundle.ref()))
+            continue;
+
+        // The material changed in structure: replace the previous translation by this one.
+        bundle->materials().insert(new_material);
+        replace_material_bundle(bundle.ref(), *assembly);
     }
 }
 
@@ -74,54 +204,37 @@ void UpdateObjectInstanceAction::update()
 {
     renderer::Assembly* assembly = m_session->m_project->get_scene()->assemblies().get_by_name("assembly");
 
+    bool assembly_changed = false;
+
     for (INode* node : m_nodes)
     {
-        if (m_session->m_object_inst_map.count(wide_to_utf8(node->GetName())) > 0)
-        {
-            m_session->m_object_map.erase(node->GetObjectRef());
-            asr::ObjectInstance* object_instance = m_session->m_object_inst_map[wide_to_utf8(node->GetName())];
-            assembly->object_instances().remove(object_instance);
-
-            add_object(
-                *m_session->m_project,
-                *assembly,
-                node,
-                RenderType::Default,
-                m_session->m_renderer_settings,
-                GetCOREInterface()->GetTime(),
-                m_session->m_object_map,
-                m_session->m_object_inst_map,
-                m_session->m_material_map,
-                m_session->m_assembly_map,
-                m_session->m_assembly_inst_map);
+        const std::string node_name = wide_to_utf8(node->GetName());
+        if (m_session->m_object_inst_map.count(node_name) == 0 &&
+            m_session->m_assembly_inst_map.count(node_name) == 0)
             continue;
-        }
-        
-        if (m_session->m_assembly_inst_map.count(wide_to_utf8(node->GetName())) > 0)
-        {
-            m_session->m_assembly_map.erase(node->GetObjectRef());
-            asr::AssemblyInstance* assembly_instance = m_session->m_assembly_inst_map[wide_to_utf8(node->GetName())];
-            assembly->assembly_instances().remove(assembly_instance);
 
-            add_object(
+        // The object changed, other nodes referencing it will rebuild it.
+        m_session->m_object_map.erase(node->GetObjectRef());
+        m_session->m_assembly_map.erase(node->GetObjectRef());
+
+        // Edited nodes get an assembly of their own to bound the cost of later edits.
+        if (update_object_assembly(
                 *m_session->m_project,
                 *assembly,
                 node,
-                RenderType::Default,
                 m_session->m_renderer_settings,
                 GetCOREInterface()->GetTime(),
-                m_session->m_object_map,
                 m_session->m_object_inst_map,
                 m_session->m_material_map,
-                m_session->m_assembly_map,
-                m_session->m_assembly_inst_map);
-        }
+                m_session->m_light_emitting_mtl_map,
+                m_session->m_assembly_inst_map))
+            assembly_changed = true;
     }
 
-    assembly->bump_version_id();
+    if (assembly_changed)
+        assembly->bump_version_id();
 }
 
-
 void RemoveObjectInstanceAction::update()
 {
     renderer::Assembly* assembly = m_session->m_project->get_scene()->assemblies().get_by_name("assembly");
@@ -164,6 +277,7 @@ void AddObjectInstanceAction::update()
             m_session->m_object_map,
             m_session->m_object_inst_map,
             m_session->m_material_map,
+            m_session->m_light_emitting_mtl_map,
             m_session->m_assembly_map,
             m_session->m_assembly_inst_map);
     }
@@ -171,18 +285,99 @@ void AddObjectInstanceAction::update()
     assembly->bump_version_id();
 }
 
+void TransformUpdateAction::update()
+{
+    renderer::Assembly* assembly = m_session->m_project->get_scene()->assemblies().get_by_name("assembly");
+
+    bool assembly_changed = false;
+
+    for (INode* node : m_nodes)
+    {
+        // Object instance transforms are baked into the acceleration structures of their assembly. On its first
+        // transform edit, the node is moved into an assembly of its own, later edits only move that assembly.
+        if (promote_object_instance(
+                *assembly,
+                node,
+                m_session->m_object_map,
+                m_session->m_object_inst_map,
+                m_session->m_assembly_inst_map))
+            assembly_changed = true;
+
+        update_object_transform(
+            *assembly,
+            node,
+            GetCOREInterface()->GetTime(),
+            m_session->m_object_map,
+            m_session->m_object_inst_map,
+            m_session->m_assembly_inst_map);
+    }
+
+    if (assembly_changed)
+        assembly->bump_version_id();
+}
+
+void AddLightAction::update()
+{
+    renderer::Assembly* assembly = m_session->m_project->get_scene()->assemblies().get_by_name("assembly");
+
+    for (INode* node : m_nodes)
+        update_light(*assembly, node, GetCOREInterface()->GetTime(), m_session->m_light_map);
+}
+
+void RemoveLightAction::update()
+{
+    renderer::Assembly* assembly = m_session->m_project->get_scene()->assemblies().get_by_name("assembly");
+
+    for (INode* node : m_nodes)
+        remove_light(*assembly, node, m_session->m_light_map);
+}
+
+void UpdateLightAction::update()
+{
+    renderer::Assembly* assembly = m_session->m_project->get_scene()->assemblies().get_by_name("assembly");
+
+    // Lights are gathered again when rendering restarts, there is no need to bump the assembly's version.
+    for (INode* node : m_nodes)
+        update_light(*assembly, node, GetCOREInterface()->GetTime(), m_session->m_light_map);
+}
+
 InteractiveRendererController::InteractiveRendererController()
-  : m_status(ContinueRendering)
+  : m_coalesced_action_count(0)
+  , m_status(ContinueRendering)
+  , m_first_frame_update_pending(false)
+  , m_reinitialize_after_frame_update(false)
+  , m_time_to_first_frame_update(-1.0)
 {
 }
 
 void InteractiveRendererController::on_rendering_begin()
 {
-    for (auto& updater : m_scheduled_actions)
+    std::vector<std::unique_ptr<ScheduledAction>> scheduled_actions;
+    size_t coalesced_action_count;
+
+    {
+        boost::mutex::scoped_lock lock(m_scheduled_actions_mutex);
+        scheduled_actions.swap(m_scheduled_actions);
+        coalesced_action_count = m_coalesced_action_count;
+        m_coalesced_action_count = 0;
+    }
+
+    if (!scheduled_actions.empty() || coalesced_action_count > 0)
+    {
+        RENDERER_LOG_INFO(
+            "applying %s scheduled update(s), %s update(s) coalesced.",
+            asf::pretty_uint(scheduled_actions.size()).c_str(),
+            asf::pretty_uint(coalesced_action_count).c_str());
+    }
+
+    for (auto& updater : scheduled_actions)
         updater->update();
-    
-    m_scheduled_actions.clear();
+
     m_status = ContinueRendering;
+    m_reinitialize_after_frame_update = false;
+
+    m_rendering_begin_time = std::chrono::steady_clock::now();
+    m_first_frame_update_pending = true;
 }
 
 asr::IRendererController::Status InteractiveRendererController::get_status() const
@@ -195,7 +390,134 @@ void InteractiveRendererController::set_status(const Status status)
     m_status = status;
 }
 
+void InteractiveRendererController::set_reinitialize_after_frame_update()
+{
+    m_reinitialize_after_frame_update = true;
+}
+
+void InteractiveRendererController::on_progressive_frame_update()
+{
+    if (m_first_frame_update_pending.exchange(false))
+    {
+        const double elapsed =
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - m_rendering_begin_time).count();
+
+        // Exponentially weighted moving average.
+        const double Alpha = 0.3;
+        const double average = m_time_to_first_frame_update;
+        m_time_to_first_frame_update = average < 0.0 ? elapsed : average + Alpha * (elapsed - average);
+    }
+
+    if (m_reinitialize_after_frame_update.exchange(false) && m_status == ContinueRendering)
+        m_status = ReinitializeRendering;
+}
+
+double InteractiveRendererController::get_time_to_first_frame_update() const
+{
+    return m_time_to_first_frame_update;
+}
+
 void InteractiveRendererController::schedule_update(std::unique_ptr<ScheduledAction> updater)
 {
+    boost::mutex::scoped_lock lock(m_scheduled_actions_mutex);
+
+    const ScheduledAction::Kind kind = updater->get_kind();
+
+    if (is_node_action(kind))
+    {
+        NodeAction& node_action = static_cast<NodeAction&>(*updater);
+        coalesce_node_action(node_action);
+
+        if (node_action.nodes().empty())
+            return;
+    }
+    else
+    {
+        // Only the latest camera or frame update matters, material updates are merged. The update takes
+        // the place of the pending one so that it still runs before the node updates scheduled after it.
+        const auto pending_it =
+            std::find_if(
+                m_scheduled_actions.begin(),
+                m_scheduled_actions.end(),
+                [kind](const std::unique_ptr<ScheduledAction>& pending) { return pending->get_kind() == kind; });
+
+        if (pending_it != m_scheduled_actions.end())
+        {
+            m_coalesced_action_count +=
+                kind == ScheduledAction::Kind::MaterialUpdate
+                    ? static_cast<MaterialUpdateAction&>(*updater).merge(static_cast<const MaterialUpdateAction&>(**pending_it))
+                    : 1;
+
+            *pending_it = std::move(updater);
+            return;
+        }
+    }
+
     m_scheduled_actions.push_back(std::move(updater));
 }
+
+void InteractiveRendererController::coalesce_node_action(NodeAction& action)
+{
+    std::vector<INode*>& nodes = action.nodes();
+
+    // Visit pending actions from the most recent one so that each node is matched against its latest state.
+    for (auto pending_it = m_scheduled_actions.rbegin(); pending_it != m_scheduled_actions.rend(); ++pending_it)
+    {
+        const ScheduledAction::Kind pending_kind = (*pending_it)->get_kind();
+        if (!is_node_action(pending_kind))
+            continue;
+
+        std::vector<INode*>& pending_nodes = static_cast<NodeAction&>(**pending_it).nodes();
+        const Coalescing coalescing = get_coalescing(pending_kind, action.get_kind());
+        if (coalescing == Coalescing::KeepBoth)
+            continue;
+
+        for (auto node_it = nodes.begin(); node_it != nodes.end(); )
+        {
+            const auto pending_node_it = std::find(pending_nodes.begin(), pending_nodes.end(), *node_it);
+            if (pending_node_it == pending_nodes.end())
+            {
+                ++node_it;
+                continue;
+            }
+
+            switch (coalescing)
+            {
+              case Coalescing::DropPending:
+                pending_nodes.erase(pending_node_it);
+                ++m_coalesced_action_count;
+                ++node_it;
+                break;
+
+              case Coalescing::DropNew:
+                node_it = nodes.erase(node_it);
+                ++m_coalesced_action_count;
+                break;
+
+              case Coalescing::DropBoth:
+                pending_nodes.erase(pending_node_it);
+                node_it = nodes.erase(node_it);
+                m_coalesced_action_count += 2;
+                break;
+
+              default:
+                ++node_it;
+                break;
+            }
+        }
+    }
+
+    // Forget pending actions that no longer target any node.
+    m_scheduled_actions.erase(
+        std::remove_if(
+            m_scheduled_actions.begin(),
+            m_scheduled_actions.end(),
+            [](const std::unique_ptr<ScheduledAction>& pending)
+            {
+                return
+                    is_node_action(pending->get_kind()) &&
+                    static_cast<NodeAction&>(*pending).nodes().empty();
+            }),
+        m_scheduled_actions.end());
+}
@@ -38,6 +38,7 @@
 #include "foundation/core/buildoptions.h"
 
 // appleseed.renderer headers.
+#include "renderer/api/frame.h"
 #include "renderer/api/project.h"
 #include "renderer/api/rendering.h"
 #include "renderer/api/scene.h"
@@ -45,7 +46,13 @@
 // appleseed.foundation headers.
 #include "foundation/memory/autoreleaseptr.h"
 
+// Boost headers.
+#include "boost/thread/mutex.hpp"
+
 // Standard headers.
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <memory>
 #include <vector>
 
@@ -56,7 +63,22 @@ namespace renderer { class Camera; }
 class ScheduledAction
 {
   public:
+    enum class Kind
+    {
+        CameraUpdate,
+        FrameUpdate,
+        MaterialUpdate,
+        AddObjectInstance,
+        RemoveObjectInstance,
+        UpdateObjectInstance,
+        TransformUpdate,
+        AddLight,
+        RemoveLight,
+        UpdateLight
+    };
+
     virtual ~ScheduledAction() {}
+    virtual Kind get_kind() const = 0;
     virtual void update() = 0;
 };
 
@@ -72,6 +94,7 @@ class CameraObjectUpdateAction
     {
     }
 
+    Kind get_kind() const override { return Kind::CameraUpdate; }
     void update() override;
 
   public:
@@ -79,80 +102,141 @@ class CameraObjectUpdateAction
     renderer::Project&                                m_project;
 };
 
+class FrameUpdateAction
+  : public ScheduledAction
+{
+  public:
+    FrameUpdateAction(
+        renderer::Project&                              project,
+        foundation::auto_release_ptr<renderer::Frame>   frame)
+      : m_project(project)
+      , m_frame(frame)
+    {
+    }
+
+    Kind get_kind() const override { return Kind::FrameUpdate; }
+    void update() override;
+
+  private:
+    renderer::Project&                                m_project;
+    foundation::auto_release_ptr<renderer::Frame>     m_frame;
+};
+
 class MaterialUpdateAction
   : public ScheduledAction
 {
   public:
     MaterialUpdateAction(
         renderer::Project&      project,
-        const IAppleseedMtlMap& material_map)
+        const IAppleseedMtlMap& material_map,
+        LightEmittingMtlMap&    light_emitting_mtl_map)
       : m_material_map(material_map)
       , m_project(project)
+      , m_light_emitting_mtl_map(light_emitting_mtl_map)
     {
     }
 
+    Kind get_kind() const override { return Kind::MaterialUpdate; }
     void update() override;
 
+    // Merge the materials of a more recent material update into this one.
+    // Return the number of materials that were already scheduled for update.
+    size_t merge(const MaterialUpdateAction& other);
+
   private:
     IAppleseedMtlMap        m_material_map;
     renderer::Project&      m_project;
+    LightEmittingMtlMap&    m_light_emitting_mtl_map;
 };
 
-class RemoveObjectInstanceAction
+// Base class for actions targeting a set of scene nodes.
+class NodeAction
   : public ScheduledAction
 {
   public:
-      RemoveObjectInstanceAction(
-          const std::vector<INode*>&    nodes,
-          InteractiveSession*           session)
+    NodeAction(
+        const std::vector<INode*>&  nodes,
+        InteractiveSession*         session)
       : m_nodes(nodes)
       , m_session(session)
     {
     }
 
-    void update() override;
+    std::vector<INode*>& nodes() { return m_nodes; }
 
-  private:
+  protected:
     std::vector<INode*>     m_nodes;
     InteractiveSession*     m_session;
 };
 
-class AddObjectInstanceAction
-  : public ScheduledAction
+class RemoveObjectInstanceAction
+  : public NodeAction
 {
   public:
-      AddObjectInstanceAction(
-          const std::vector<INode*>&    nodes,
-          InteractiveSession*           session)
-      : m_nodes(nodes)
-      , m_session(session)
-    {
-    }
+    using NodeAction::NodeAction;
 
+    Kind get_kind() const override { return Kind::RemoveObjectInstance; }
     void update() override;
+};
 
-  private:
-    std::vector<INode*>     m_nodes;
-    InteractiveSession*     m_session;
+class AddObjectInstanceAction
+  : public NodeAction
+{
+  public:
+    using NodeAction::NodeAction;
+
+    Kind get_kind() const override { return Kind::AddObjectInstance; }
+    void update() override;
 };
 
 class UpdateObjectInstanceAction
-  : public ScheduledAction
+  : public NodeAction
 {
   public:
-      UpdateObjectInstanceAction(
-          const std::vector<INode*>&    nodes,
-          InteractiveSession*           session)
-      : m_nodes(nodes)
-      , m_session(session)
-    {
-    }
+    using NodeAction::NodeAction;
 
+    Kind get_kind() const override { return Kind::UpdateObjectInstance; }
     void update() override;
+};
 
-  private:
-    std::vector<INode*>     m_nodes;
-    InteractiveSession*     m_session;
+class TransformUpdateAction
+  : public NodeAction
+{
+  public:
+    using NodeAction::NodeAction;
+
+    Kind get_kind() const override { return Kind::TransformUpdate; }
+    void update() override;
+};
+
+class AddLightAction
+  : public NodeAction
+{
+  public:
+    using NodeAction::NodeAction;
+
+    Kind get_kind() const override { return Kind::AddLight; }
+    void update() override;
+};
+
+class RemoveLightAction
+  : public NodeAction
+{
+  public:
+    using NodeAction::NodeAction;
+
+    Kind get_kind() const override { return Kind::RemoveLight; }
+    void update() override;
+};
+
+class UpdateLightAction
+  : public NodeAction
+{
+  public:
+    using NodeAction::NodeAction;
+
+    Kind get_kind() const override { return Kind::UpdateLight; }
+    void update() override;
 };
 
 class InteractiveRendererController
@@ -166,9 +250,28 @@ class InteractiveRendererController
 
     void set_status(const Status status);
 
+    // Reinitialize rendering at the next progressive frame update instead of right away.
+    void set_reinitialize_after_frame_update();
+
+    // Called by the tile callback whenever a progressive frame update was published.
+    void on_progressive_frame_update();
+
+    // Return a moving average of the time it takes to produce the first frame update
+    // after rendering (re)starts, in milliseconds, or a negative value if unknown.
+    double get_time_to_first_frame_update() const;
+
+    // Thread-safe. Pending actions made redundant by `updater` are coalesced with it.
     void schedule_update(std::unique_ptr<ScheduledAction> updater);
 
   private:
+    boost::mutex                                    m_scheduled_actions_mutex;
     std::vector<std::unique_ptr<ScheduledAction>>   m_scheduled_actions;
+    size_t                                          m_coalesced_action_count;
     Status                                          m_status;
+    std::chrono::steady_clock::time_point           m_rendering_begin_time;
+    std::atomic<bool>                               m_first_frame_update_pending;
+    std::atomic<bool>                               m_reinitialize_after_frame_update;
+    std::atomic<double>                             m_time_to_first_frame_update;
+
+    void coalesce_node_action(NodeAction& action);
 };
@@ -39,6 +39,7 @@
 #include "foundation/core/buildoptions.h"
 
 // appleseed.renderer headers.
+#include "renderer/api/frame.h"
 #include "renderer/api/project.h"
 #include "renderer/api/rendering.h"
 
@@ -52,15 +53,13 @@ InteractiveSession::InteractiveSession(
   : m_irender_manager(irender_manager)
   , m_renderer_settings(settings)
   , m_bitmap(bitmap)
-  , m_renderer_controller(nullptr)
+  , m_renderer_controller(new InteractiveRendererController())
+  , m_resolution_divisor(1)
 {
 }
 
 void InteractiveSession::render_thread()
 {
-    // Create the renderer controller.
-    m_renderer_controller.reset(new InteractiveRendererController());
-
     // Create the tile callback.
     InteractiveTileCallback m_tile_callback(
         m_bitmap,
@@ -81,6 +80,7 @@ void InteractiveSession::render_thread()
 
 void InteractiveSession::start_render()
 {
+    m_renderer_controller->set_status(asr::IRendererController::ContinueRendering);
     m_render_thread = std::thread(&InteractiveSession::render_thread, this);
 }
 
@@ -94,12 +94,37 @@ void InteractiveSession::reininitialize_render()
     m_renderer_controller->set_status(asr::IRendererController::ReinitializeRendering);
 }
 
+void InteractiveSession::reininitialize_render_after_frame_update()
+{
+    m_renderer_controller->set_reinitialize_after_frame_update();
+}
+
+double InteractiveSession::get_time_to_first_frame_update() const
+{
+    return m_renderer_controller->get_time_to_first_frame_update();
+}
+
 void InteractiveSession::end_render()
 {
     if (m_render_thread.joinable())
         m_render_thread.join();
 }
 
+void InteractiveSession::resume(
+    IIRenderMgr*                irender_manager,
+    const RendererSettings&     settings,
+    Bitmap*                     bitmap)
+{
+    m_irender_manager = irender_manager;
+    m_renderer_settings = settings;
+    m_bitmap = bitmap;
+
+    // Settings and bitmap may have changed since the session ended.
+    m_renderer_settings.apply(*m_project);
+    m_resolution_divisor = 1;
+    schedule_frame_update();
+}
+
 void InteractiveSession::schedule_camera_update(
     asf::auto_release_ptr<asr::Camera>  camera)
 {
@@ -108,11 +133,45 @@ void InteractiveSession::schedule_camera_update(
             new CameraObjectUpdateAction(*m_project, camera)));
 }
 
+void InteractiveSession::schedule_frame_resolution_update(const size_t resolution_divisor)
+{
+    if (resolution_divisor == m_resolution_divisor)
+        return;
+
+    m_resolution_divisor = resolution_divisor;
+    schedule_frame_update();
+}
+
+void InteractiveSession::schedule_priority_region_update(const Box2& region)
+{
+    if (region.IsEmpty() && m_priority_region.IsEmpty())
+        return;
+
+    if (region.left == m_priority_region.left &&
+        region.top == m_priority_region.top &&
+        region.right == m_priority_region.right &&
+        region.bottom == m_priority_region.bottom)
+        return;
+
+    m_priority_region = region;
+    schedule_frame_update();
+}
+
+void InteractiveSession::schedule_frame_update()
+{
+    // The frame is built here since it requires access to the render elements of the scene.
+    m_renderer_controller->schedule_update(
+        std::unique_ptr<ScheduledAction>(
+            new FrameUpdateAction(
+                *m_project,
+                build_interactive_frame(m_bitmap, m_renderer_settings, m_resolution_divisor, m_priority_region))));
+}
+
 void InteractiveSession::schedule_material_update(const IAppleseedMtlMap& material_map)
 {
     m_renderer_controller->schedule_update(
         std::unique_ptr<ScheduledAction>(
-            new MaterialUpdateAction(*m_project, material_map)));
+            new MaterialUpdateAction(*m_project, material_map, m_light_emitting_mtl_map)));
 }
 
 void InteractiveSession::schedule_add_object_instance(const std::vector<INode*>& nodes)
@@ -135,3 +194,31 @@ void InteractiveSession::schedule_udpate_object_instance(const std::vector<INode
         std::unique_ptr<ScheduledAction>(
             new UpdateObjectInstanceAction(nodes, this)));
 }
+
+void InteractiveSession::schedule_transform_update(const std::vector<INode*>& nodes)
+{
+    m_renderer_controller->schedule_update(
+        std::unique_ptr<ScheduledAction>(
+            new TransformUpdateAction(nodes, this)));
+}
+
+void InteractiveSession::schedule_add_light(const std::vector<INode*>& nodes)
+{
+    m_renderer_controller->schedule_update(
+        std::unique_ptr<ScheduledAction>(
+            new AddLightAction(nodes, this)));
+}
+
+void InteractiveSession::schedule_remove_light(const std::vector<INode*>& nodes)
+{
+    m_renderer_controller->schedule_update(
+        std::unique_ptr<ScheduledAction>(
+            new RemoveLightAction(nodes, this)));
+}
+
+void InteractiveSession::schedule_update_light(const std::vector<INode*>& nodes)
+{
+    m_renderer_controller->schedule_update(
+        std::unique_ptr<ScheduledAction>(
+            new UpdateLightAction(nodes, this)));
+}
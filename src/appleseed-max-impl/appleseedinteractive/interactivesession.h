@@ -41,6 +41,7 @@
 #include "foundation/utility/searchpaths.h"
 
 // Standard headers.
+#include <cstddef>
 #include <memory>
 #include <thread>
 
@@ -62,21 +63,41 @@ class InteractiveSession
     void start_render();
     void abort_render();
     void reininitialize_render();
+    void reininitialize_render_after_frame_update();
     void end_render();
 
+    // Return the average time to the first frame update after a restart in milliseconds, or a negative value if unknown.
+    double get_time_to_first_frame_update() const;
+
+    // Prepare a session that ended to render again, possibly into a different bitmap.
+    void resume(
+        IIRenderMgr*                irender_manager,
+        const RendererSettings&     settings,
+        Bitmap*                     bitmap);
+
     void schedule_camera_update(foundation::auto_release_ptr<renderer::Camera> camera);
+    void schedule_frame_resolution_update(const size_t resolution_divisor);
+
+    // Restrict rendering to a region of the frame, or render the whole frame again if `region` is empty.
+    void schedule_priority_region_update(const Box2& region);
     void schedule_material_update(const IAppleseedMtlMap& material_map);
     void schedule_remove_object_instance(const std::vector<INode*>&);
     void schedule_add_object_instance(const std::vector<INode*>&);
     void schedule_udpate_object_instance(const std::vector<INode*>&);
+    void schedule_transform_update(const std::vector<INode*>&);
+    void schedule_add_light(const std::vector<INode*>&);
+    void schedule_remove_light(const std::vector<INode*>&);
+    void schedule_update_light(const std::vector<INode*>&);
 
     renderer::Project*                              m_project;
     ObjectMap                                       m_object_map;
     ObjectInstanceMap                               m_object_inst_map;
     MaterialMap                                     m_material_map;
+    LightEmittingMtlMap                             m_light_emitting_mtl_map;
     RendererSettings                                m_renderer_settings;
     AssemblyMap                                     m_assembly_map;
     AssemblyInstanceMap                             m_assembly_inst_map;
+    LightMap                                        m_light_map;
 
   private:
     std::unique_ptr<InteractiveRendererController>  m_renderer_controller;
@@ -84,6 +105,9 @@ class InteractiveSession
     Bitmap*                                         m_bitmap;
     IIRenderMgr*                                    m_irender_manager;
     foundation::SearchPaths                         m_search_paths;
+    size_t                                          m_resolution_divisor;
+    Box2                                            m_priority_region;
 
     void render_thread();
+    void schedule_frame_update();
 };
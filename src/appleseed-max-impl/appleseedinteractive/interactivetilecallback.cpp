@@ -29,6 +29,18 @@
 // Interface header.
 #include "interactivetilecallback.h"
 
+// appleseed-max headers.
+#include "appleseedinteractive/interactiverenderercontroller.h"
+
+// appleseed.renderer headers.
+#include "renderer/api/frame.h"
+
+// appleseed.foundation headers.
+#include "foundation/image/canvasproperties.h"
+#include "foundation/image/image.h"
+#include "foundation/image/pixel.h"
+#include "foundation/image/tile.h"
+
 // 3ds Max headers.
 #include "appleseed-max-common/_beginmaxheaders.h"
 #include <bitmap.h>
@@ -36,6 +48,10 @@
 #include <maxapi.h>
 #include "appleseed-max-common/_endmaxheaders.h"
 
+// Standard headers.
+#include <algorithm>
+
+namespace asf = foundation;
 namespace asr = renderer;
 
 
@@ -46,17 +62,66 @@ namespace asr = renderer;
 namespace
 {
     const UINT WM_TRIGGER_CALLBACK = WM_USER + 4764;
+
+    // Convert the frame to 32-bit floating point RGBA pixels.
+    void copy_frame(
+        const asr::Frame&       frame,
+        std::vector<asf::Color4f>& pixels)
+    {
+        const asf::Image& image = frame.image();
+        const asf::CanvasProperties& props = image.properties();
+
+        pixels.resize(props.m_pixel_count);
+
+        for (size_t tile_y = 0; tile_y < props.m_tile_count_y; ++tile_y)
+        {
+            for (size_t tile_x = 0; tile_x < props.m_tile_count_x; ++tile_x)
+            {
+                const asf::Tile& tile = image.tile(tile_x, tile_y);
+                const size_t tile_width = tile.get_width();
+                const size_t row_size = tile_width * tile.get_pixel_size();
+                const size_t x = tile_x * props.m_tile_width;
+                const size_t y = tile_y * props.m_tile_height;
+
+                for (size_t py = 0; py < tile.get_height(); ++py)
+                {
+                    const std::uint8_t* src = tile.pixel(0, py);
+
+                    asf::Pixel::convert_from_format<float>(
+                        tile.get_pixel_format(),
+                        src,
+                        src + row_size,
+                        1,
+                        &pixels[(y + py) * props.m_canvas_width + x][0],
+                        1);
+                }
+            }
+        }
+    }
 }
 
+std::mutex InteractiveTileCallback::s_handoffs_mutex;
+std::vector<InteractiveTileCallback::FrameHandoff*> InteractiveTileCallback::s_handoffs;
+
 InteractiveTileCallback::InteractiveTileCallback(
-    Bitmap*                     bitmap,
-    IIRenderMgr*                irender_manager,
-    asr::IRendererController*   renderer_controller)
+    Bitmap*                         bitmap,
+    IIRenderMgr*                    irender_manager,
+    InteractiveRendererController*  renderer_controller)
   : TileCallback(bitmap, nullptr)
-  , m_bitmap(bitmap)
-  , m_irender_manager(irender_manager)
   , m_renderer_controller(renderer_controller)
 {
+    m_handoff.m_bitmap = bitmap;
+    m_handoff.m_irender_manager = irender_manager;
+
+    std::lock_guard<std::mutex> lock(s_handoffs_mutex);
+    s_handoffs.push_back(&m_handoff);
+}
+
+InteractiveTileCallback::~InteractiveTileCallback()
+{
+    // Pending UI messages won't find this handoff anymore.
+    std::lock_guard<std::mutex> lock(s_handoffs_mutex);
+    s_handoffs.erase(std::find(s_handoffs.begin(), s_handoffs.end(), &m_handoff));
 }
 
 void InteractiveTileCallback::on_progressive_frame_update(
@@ -66,32 +131,105 @@ void InteractiveTileCallback::on_progressive_frame_update(
     const double                samples_per_pixel,
     const std::uint64_t         samples_per_second)
 {
-    TileCallback::on_progressive_frame_update(
-        frame,
-        time,
-        samples,
-        samples_per_pixel,
-        samples_per_second);
-
-    // Wait until UI proc gets handled to ensure class object is valid.
-    m_ui_promise = std::promise<void>();
-    if (m_renderer_controller->get_status() == asr::IRendererController::ContinueRendering)
+    const asf::CanvasProperties& props = frame.image().properties();
+
+    // Fill the back buffer.
+    FrameBuffer& buffer = m_handoff.m_buffers[m_back];
+    buffer.m_width = props.m_canvas_width;
+    buffer.m_height = props.m_canvas_height;
+    buffer.m_crop_window = frame.get_crop_window();
+    copy_frame(frame, buffer.m_pixels);
+
+    // Publish it and take over the previous ready buffer, the UI thread only ever touches the front buffer.
+    const std::uint32_t previous =
+        m_handoff.m_ready.exchange(
+            static_cast<std::uint32_t>(m_back) | FrameHandoff::FreshBit,
+            std::memory_order_acq_rel);
+    m_back = previous & ~FrameHandoff::FreshBit;
+
+    // Wake up the UI thread, unless it has yet to handle a previous request.
+    if (m_renderer_controller->get_status() == asr::IRendererController::ContinueRendering &&
+        !m_handoff.m_update_pending.exchange(true))
     {
         PostMessage(
             GetCOREInterface()->GetMAXHWnd(),
             WM_TRIGGER_CALLBACK,
             reinterpret_cast<UINT_PTR>(update_caller),
-            reinterpret_cast<UINT_PTR>(this));
-        m_ui_promise.get_future().wait();
+            0);
     }
+
+    // Let the controller apply deferred updates now that this pass is on screen.
+    m_renderer_controller->on_progressive_frame_update();
 }
 
 void InteractiveTileCallback::update_caller(UINT_PTR param_ptr)
 {
-    auto tile_callback = reinterpret_cast<InteractiveTileCallback*>(param_ptr);
-    
-    if (tile_callback->m_irender_manager->IsRendering())
-        tile_callback->m_irender_manager->UpdateDisplay();
+    std::lock_guard<std::mutex> lock(s_handoffs_mutex);
+
+    for (FrameHandoff* handoff : s_handoffs)
+    {
+        if (handoff->m_update_pending)
+            display_frame(*handoff);
+    }
+}
+
+void InteractiveTileCallback::display_frame(FrameHandoff& handoff)
+{
+    // Clear the flag before taking the buffer so that frames published from now on trigger a new update.
+    handoff.m_update_pending = false;
+
+    // Take the latest published frame, if it wasn't displayed yet.
+    if ((handoff.m_ready.load(std::memory_order_acquire) & FrameHandoff::FreshBit) == 0)
+        return;
+    handoff.m_front =
+        handoff.m_ready.exchange(
+            static_cast<std::uint32_t>(handoff.m_front),
+            std::memory_order_acq_rel) & ~FrameHandoff::FreshBit;
+
+    const FrameBuffer& buffer = handoff.m_buffers[handoff.m_front];
+    const size_t bitmap_width = static_cast<size_t>(handoff.m_bitmap->Width());
+    const size_t bitmap_height = static_cast<size_t>(handoff.m_bitmap->Height());
+
+    // Only update the part of the bitmap covered by the crop window, so that the rest keeps the previous image.
+    const asf::AABB2u& crop = buffer.m_crop_window;
+
+    if (buffer.m_width == bitmap_width && buffer.m_height == bitmap_height)
+    {
+        // Blit the frame one row at a time.
+        // BMM_Color_fl is laid out as four consecutive floats, just like Color4f.
+        for (size_t y = crop.min.y; y <= crop.max.y; ++y)
+        {
+            handoff.m_bitmap->PutPixels(
+                static_cast<int>(crop.min.x),
+                static_cast<int>(y),
+                static_cast<int>(crop.max.x - crop.min.x + 1),
+                reinterpret_cast<BMM_Color_fl*>(
+                    const_cast<asf::Color4f*>(&buffer.m_pixels[y * buffer.m_width + crop.min.x])));
+        }
+    }
+    else
+    {
+        // Upscale low resolution preview frames using nearest neighbor filtering.
+        const size_t x0 = (crop.min.x * bitmap_width + buffer.m_width - 1) / buffer.m_width;
+        const size_t y0 = (crop.min.y * bitmap_height + buffer.m_height - 1) / buffer.m_height;
+        const size_t x1 = std::min(((crop.max.x + 1) * bitmap_width + buffer.m_width - 1) / buffer.m_width, bitmap_width);
+        const size_t y1 = std::min(((crop.max.y + 1) * bitmap_height + buffer.m_height - 1) / buffer.m_height, bitmap_height);
+
+        handoff.m_row.resize(bitmap_width);
+        for (size_t y = y0; y < y1; ++y)
+        {
+            const asf::Color4f* src_row = &buffer.m_pixels[(y * buffer.m_height / bitmap_height) * buffer.m_width];
+            for (size_t x = x0; x < x1; ++x)
+                handoff.m_row[x - x0] = src_row[x * buffer.m_width / bitmap_width];
+
+            handoff.m_bitmap->PutPixels(
+                static_cast<int>(x0),
+                static_cast<int>(y),
+                static_cast<int>(x1 - x0),
+                reinterpret_cast<BMM_Color_fl*>(&handoff.m_row[0]));
+        }
+    }
 
-    tile_callback->m_ui_promise.set_value();
+    if (handoff.m_irender_manager->IsRendering())
+        handoff.m_irender_manager->UpdateDisplay();
 }
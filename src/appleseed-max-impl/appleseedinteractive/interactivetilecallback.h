@@ -35,18 +35,23 @@
 #include "foundation/core/buildoptions.h"
 
 // appleseed.foundation headers.
+#include "foundation/image/color.h"
+#include "foundation/math/aabb.h"
 #include "foundation/platform/types.h"
 #include "foundation/platform/windows.h"
 
 // Standard headers.
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
-#include <future>
+#include <mutex>
+#include <vector>
 
 // Forward declarations.
 namespace renderer  { class Frame; }
-namespace renderer  { class IRendererController; }
 class Bitmap;
 class IIRenderMgr;
+class InteractiveRendererController;
 
 class InteractiveTileCallback
   : public TileCallback
@@ -55,7 +60,9 @@ class InteractiveTileCallback
     InteractiveTileCallback(
         Bitmap*                         bitmap,
         IIRenderMgr*                    irender_manager,
-        renderer::IRendererController*  renderer_controller);
+        InteractiveRendererController*  renderer_controller);
+
+    ~InteractiveTileCallback() override;
 
     void on_progressive_frame_update(
         const renderer::Frame&          frame,
@@ -65,10 +72,40 @@ class InteractiveTileCallback
         const std::uint64_t             samples_per_second) override;
 
   private:
-    Bitmap*                             m_bitmap;
-    IIRenderMgr*                        m_irender_manager;
-    renderer::IRendererController*      m_renderer_controller;
-    std::promise<void>                  m_ui_promise;
+    struct FrameBuffer
+    {
+        size_t                          m_width = 0;
+        size_t                          m_height = 0;
+        std::vector<foundation::Color4f> m_pixels;
+        foundation::AABB2u              m_crop_window;      // pixels outside of it weren't rendered
+    };
+
+    // Triple-buffered handoff of progressive frames from the render thread to the UI thread.
+    // The render thread owns the back buffer, the UI thread owns the front buffer, and they
+    // exchange buffers with the ready slot without ever waiting on each other.
+    struct FrameHandoff
+    {
+        static const std::uint32_t      FreshBit = 4;       // set when the ready buffer hasn't been displayed yet
+
+        Bitmap*                         m_bitmap;
+        IIRenderMgr*                    m_irender_manager;
+        FrameBuffer                     m_buffers[3];
+        std::atomic<std::uint32_t>      m_ready{1};
+        size_t                          m_front = 2;        // only accessed by the UI thread
+        std::vector<foundation::Color4f> m_row;             // upscaling scratch memory, only accessed by the UI thread
+        std::atomic<bool>               m_update_pending{false};
+    };
+
+    InteractiveRendererController*      m_renderer_controller;
+    FrameHandoff                        m_handoff;
+    size_t                              m_back = 0;         // only accessed by the render thread
+
+    // Handoffs of all live tile callbacks. UI messages carry no payload and look them up here
+    // instead, so that messages handled after the tile callback is destroyed are harmless.
+    static std::mutex                   s_handoffs_mutex;
+    static std::vector<FrameHandoff*>   s_handoffs;
 
     static void update_caller(UINT_PTR param_ptr);
+
+    static void display_frame(FrameHandoff& handoff);
 };
@@ -35,6 +35,7 @@
 #include "appleseedrenderer/appleseedrendererparamdlg.h"
 #include "appleseedrenderer/datachunks.h"
 #include "appleseedrenderer/dialoglogtarget.h"
+#include "appleseedrenderer/localprocessrenderer.h"
 #include "appleseedrenderer/projectbuilder.h"
 #include "appleseedrenderer/renderercontroller.h"
 #include "appleseedrenderer/tilecallback.h"
@@ -48,13 +49,16 @@
 
 // appleseed.renderer headers.
 #include "renderer/api/frame.h"
+#include "renderer/api/log.h"
 #include "renderer/api/project.h"
 #include "renderer/api/rendering.h"
+#include "renderer/api/scene.h"
 
 // appleseed.foundation headers.
 #include "foundation/image/canvasproperties.h"
 #include "foundation/image/image.h"
 #include "foundation/memory/autoreleaseptr.h"
+#include "foundation/platform/atomic.h"
 #include "foundation/platform/system.h"
 #include "foundation/platform/thread.h"
 #include "foundation/utility/kvpair.h"
@@ -72,11 +76,16 @@
 #include "appleseed-max-common/_endmaxheaders.h"
 
 // Standard headers.
+#include <atomic>
+#include <chrono>
 #include <clocale>
 #include <cstddef>
 #include <cstdint>
 #include <limits>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace asf = foundation;
 namespace asr = renderer;
@@ -119,6 +128,10 @@ namespace
         ParamIdBackgroundAlphaValue                     = 15,
         ParamIdNoiseSeed                                = 76,
         ParamIdEnablePerFrameNoiseSeedVariation         = 77,
+        ParamIdEnableCheckpoint                         = 85,
+        ParamIdResumeFromCheckpoint                     = 86,
+        ParamIdRenderTimeLimit                          = 87,
+        ParamIdRenderNoiseTarget                        = 88,
 
         ParamIdLightingAlgorithm                        = 52,
         ParamIdForceDefaultLightsOff                    = 13,
@@ -382,6 +395,22 @@ void AppleseedRendererPBlockAccessor::Get(
         v.i = static_cast<int>(settings.m_enable_noise_seed);
         break;
 
+      case ParamIdEnableCheckpoint:
+        v.i = static_cast<int>(settings.m_enable_checkpoint);
+        break;
+
+      case ParamIdResumeFromCheckpoint:
+        v.i = static_cast<int>(settings.m_resume_from_checkpoint);
+        break;
+
+      case ParamIdRenderTimeLimit:
+        v.i = settings.m_render_time_limit;
+        break;
+
+      case ParamIdRenderNoiseTarget:
+        v.f = settings.m_render_noise_target;
+        break;
+
       //
       // Adaptive Tile Renderer.
       //
@@ -771,6 +800,22 @@ void AppleseedRendererPBlockAccessor::Set(
         settings.m_enable_noise_seed = v.i > 0;
         break;
 
+      case ParamIdEnableCheckpoint:
+        settings.m_enable_checkpoint = v.i > 0;
+        break;
+
+      case ParamIdResumeFromCheckpoint:
+        settings.m_resume_from_checkpoint = v.i > 0;
+        break;
+
+      case ParamIdRenderTimeLimit:
+        settings.m_render_time_limit = v.i;
+        break;
+
+      case ParamIdRenderNoiseTarget:
+        settings.m_render_noise_target = v.f;
+        break;
+
       //
       // Adaptive Tile Renderer.
       //
@@ -1315,6 +1360,32 @@ ParamBlockDesc2 g_param_block_desc(
         p_accessor, &g_pblock_accessor,
     p_end,
 
+    ParamIdEnableCheckpoint, L"enable_checkpoint", TYPE_BOOL, P_TRANSIENT, 0,
+        p_ui, ParamMapIdImageSampling, TYPE_SINGLECHEKBOX, IDC_CHECK_ENABLE_CHECKPOINT,
+        p_default, FALSE,
+        p_accessor, &g_pblock_accessor,
+    p_end,
+
+    ParamIdResumeFromCheckpoint, L"resume_from_checkpoint", TYPE_BOOL, P_TRANSIENT, 0,
+        p_ui, ParamMapIdImageSampling, TYPE_SINGLECHEKBOX, IDC_CHECK_RESUME_FROM_CHECKPOINT,
+        p_default, FALSE,
+        p_accessor, &g_pblock_accessor,
+    p_end,
+
+    ParamIdRenderTimeLimit, L"render_time_limit", TYPE_INT, P_TRANSIENT, 0,
+        p_ui, ParamMapIdImageSampling, TYPE_SPINNER, EDITTYPE_INT, IDC_TEXT_RENDER_TIME_LIMIT, IDC_SPINNER_RENDER_TIME_LIMIT, SPIN_AUTOSCALE,
+        p_default, 0,
+        p_range, 0, 1000000,
+        p_accessor, &g_pblock_accessor,
+    p_end,
+
+    ParamIdRenderNoiseTarget, L"render_noise_target", TYPE_FLOAT, P_TRANSIENT, 0,
+        p_ui, ParamMapIdImageSampling, TYPE_SPINNER, EDITTYPE_FLOAT, IDC_TEXT_RENDER_NOISE_TARGET, IDC_SPINNER_RENDER_NOISE_TARGET, SPIN_AUTOSCALE,
+        p_default, 0.0f,
+        p_range, 0.0f, 1.0f,
+        p_accessor, &g_pblock_accessor,
+    p_end,
+
     // --- Parameters specifications for Lighting rollup ---
 
     ParamIdLightingAlgorithm, L"lighting_algorithm", TYPE_INT, P_TRANSIENT, 0,
@@ -2091,11 +2162,102 @@ namespace
         proc.EndEnumeration();
     }
 
+    // Write a project file before the project is rendered, and its geometry files on a background thread
+    // while the project is being rendered.
+    class BackgroundProjectWriter
+    {
+      public:
+        BackgroundProjectWriter(
+            asr::Project&       project,
+            const std::string&  filepath)
+          : m_project(project)
+          , m_filepath(filepath)
+          , m_project_file_written(false)
+          , m_started(false)
+          , m_done(false)
+        {
+        }
+
+        ~BackgroundProjectWriter()
+        {
+            if (m_thread.joinable())
+                m_thread.join();
+        }
+
+        // Must be called while the project isn't being rendered. Only the first call has an effect.
+        void write_project()
+        {
+            if (m_project_file_written)
+                return;
+
+            m_project_file_written = true;
+
+            write_project_file(m_project, m_filepath, m_geometry_files);
+        }
+
+        // Start writing geometry files. Only the first call has an effect.
+        void start()
+        {
+            if (m_started.exchange(true))
+                return;
+
+            RENDERER_LOG_INFO("writing geometry files of project file %s in the background...", m_filepath.c_str());
+
+            m_thread = std::thread(
+                [this]()
+                {
+                    const auto start_time = std::chrono::steady_clock::now();
+
+                    if (write_geometry_files(m_geometry_files))
+                    {
+                        RENDERER_LOG_INFO(
+                            "wrote geometry files of project file %s in %.1f seconds.",
+                            m_filepath.c_str(),
+                            std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
+                    }
+
+                    m_done = true;
+                });
+        }
+
+        // Wait until the project is written, keeping the progress dialog alive.
+        void wait(RendProgressCallback* progress_cb)
+        {
+            // Rendering may have been aborted before the project was written, or the project
+            // may have been rendered without going through render().
+            write_project();
+            start();
+
+            if (!m_done && progress_cb)
+                progress_cb->SetTitle(L"Writing Project To Disk...");
+
+            while (!m_done)
+            {
+                if (progress_cb)
+                    progress_cb->Progress(0, 1);
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+
+            m_thread.join();
+        }
+
+      private:
+        asr::Project&               m_project;
+        const std::string           m_filepath;
+        std::vector<GeometryFile>   m_geometry_files;
+        bool                        m_project_file_written;
+        std::atomic<bool>           m_started;
+        std::atomic<bool>           m_done;
+        std::thread                 m_thread;
+    };
+
     asr::IRendererController::Status render(
-        asr::Project&           project,
-        const RendererSettings& settings,
-        Bitmap*                 bitmap,
-        RendProgressCallback*   progress_cb)
+        asr::Project&               project,
+        const RendererSettings&     settings,
+        Bitmap*                     bitmap,
+        RendProgressCallback*       progress_cb,
+        BackgroundProjectWriter*    project_writer = nullptr)
     {
         // Number of rendered tiles, shared counter accessed atomically.
         volatile std::uint32_t rendered_tile_count = 0;
@@ -2109,8 +2271,21 @@ namespace
             &rendered_tile_count,
             total_tile_count);
 
+        // Only write geometry files once the renderer has prepared the scene, which may update objects.
+        if (project_writer != nullptr)
+        {
+            project_writer->write_project();
+            renderer_controller.set_frame_begin_callback([project_writer]() { project_writer->start(); });
+        }
+
+        renderer_controller.set_render_budget(
+            *project.get_frame(),
+            static_cast<size_t>(settings.m_passes),
+            static_cast<double>(settings.m_render_time_limit),
+            settings.m_render_noise_target);
+
         // Create the tile callback.
-        TileCallback tile_callback(bitmap, &rendered_tile_count);
+        TileCallback tile_callback(bitmap, &rendered_tile_count, &renderer_controller);
 
         // Create the master renderer.
         asf::SearchPaths search_paths;
@@ -2128,6 +2303,124 @@ namespace
 
         // Make sure the master renderer is deleted before the project.
     }
+
+    asr::IRendererController::Status render_pipelined(
+        asr::Project&               project,
+        const std::vector<INode*>&  objects,
+        const RendererSettings&     settings,
+        Bitmap*                     bitmap,
+        const TimeValue             time,
+        MaterialMap&                material_map,
+        LightEmittingMtlMap&        light_emitting_mtl_map,
+        RendProgressCallback*       progress_cb)
+    {
+        // Number of rendered tiles, shared counter accessed atomically.
+        volatile std::uint32_t rendered_tile_count = 0;
+
+        // Create the renderer controller.
+        const size_t total_tile_count =
+              static_cast<size_t>(settings.m_passes)
+            * project.get_frame()->image().properties().m_tile_count;
+        asr::Assembly& assembly = *project.get_scene()->assemblies().get_by_name("assembly");
+        PipelinedRendererController renderer_controller(assembly, &rendered_tile_count);
+
+        // Create the tile callback.
+        TileCallback tile_callback(bitmap, &rendered_tile_count);
+
+        // Create the master renderer.
+        asf::SearchPaths search_paths;
+        std::unique_ptr<asr::MasterRenderer> renderer(
+            new asr::MasterRenderer(
+                project,
+                project.configurations().get_by_name("final")->get_inherited_parameters(),
+                search_paths,   // don't pass a temporary because MasterRenderer only holds a const reference to the search paths
+                &tile_callback));
+
+        // Render on a separate thread while objects are translated on this one,
+        // since 3ds Max objects may only be evaluated from the main thread. The frame may
+        // complete before all objects are translated, render it again with the late ones.
+        std::atomic<bool> rendering_done(false);
+        std::thread render_thread(
+            [&]()
+            {
+                do
+                {
+                    renderer->render(renderer_controller);
+                } while (renderer_controller.wait_for_assemblies());
+
+                rendering_done = true;
+            });
+
+        // Hand translated objects over to the renderer in batches, so that it doesn't restart too often.
+        const auto batch_duration = std::chrono::milliseconds(load_system_setting(L"PipelinedRenderingBatchDuration", 1000));
+        asf::auto_release_ptr<asr::Assembly> batch;
+        size_t batch_count = 0;
+        auto batch_start_time = std::chrono::steady_clock::now();
+        ObjectMap object_map;
+        ObjectInstanceMap object_inst_map;
+        AssemblyMap assembly_map;
+        AssemblyInstanceMap assembly_inst_map;
+
+        for (size_t i = 0, e = objects.size(); i < e; ++i)
+        {
+            if (batch.get() == nullptr)
+            {
+                // Each batch is self-contained, only materials are shared through the parent assembly.
+                const std::string batch_name = "batch_" + std::to_string(batch_count++) + "_assembly";
+                batch.reset(asr::AssemblyFactory().create(batch_name.c_str()).release());
+                object_map.clear();
+                object_inst_map.clear();
+                assembly_map.clear();
+                assembly_inst_map.clear();
+                batch_start_time = std::chrono::steady_clock::now();
+            }
+
+            add_object(
+                project,
+                batch.ref(),
+                objects[i],
+                RenderType::Default,
+                settings,
+                time,
+                object_map,
+                object_inst_map,
+                material_map,
+                light_emitting_mtl_map,
+                assembly_map,
+                assembly_inst_map);
+
+            if (i + 1 == e || std::chrono::steady_clock::now() - batch_start_time >= batch_duration)
+                renderer_controller.add_assembly(batch);
+
+            if (progress_cb && progress_cb->Progress(static_cast<int>(i + 1), static_cast<int>(e)) == RENDPROG_ABORT)
+            {
+                renderer_controller.abort_rendering();
+                break;
+            }
+        }
+
+        renderer_controller.end_assemblies();
+
+        if (progress_cb)
+            progress_cb->SetTitle(L"Rendering...");
+
+        // Keep the progress dialog alive until rendering completes.
+        while (!rendering_done)
+        {
+            const int done = static_cast<int>(asf::atomic_read(&rendered_tile_count));
+            const int total = static_cast<int>(total_tile_count);
+            if (progress_cb && progress_cb->Progress(done, total) == RENDPROG_ABORT)
+                renderer_controller.abort_rendering();
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        render_thread.join();
+
+        return renderer_controller.get_status();
+
+        // Make sure the master renderer is deleted before the project.
+    }
 }
 
 int AppleseedRenderer::Render(
@@ -2204,11 +2497,39 @@ int AppleseedRenderer::Render(
     if (progress_cb)
         progress_cb->SetTitle(L"Building Project...");
 
+    // In pipelined mode, objects are translated while rendering is already underway.
+    const bool pipelined =
+        !m_rend_params.inMtlEdit &&
+        m_settings.m_output_mode == RendererSettings::OutputMode::RenderOnly &&
+        load_system_setting(L"PipelinedRendering", 0) != 0;
+
+    // Optionally split final renders among several local appleseed.cli processes.
+    // 3ds Max procedural maps are only available inside 3ds Max.
+    const int local_process_count = load_system_setting(L"LocalRenderProcesses", 0);
+    const std::string cli_path =
+        !m_rend_params.inMtlEdit &&
+        !pipelined &&
+        !m_settings.m_use_max_procedural_maps &&
+        local_process_count > 1
+            ? find_appleseed_cli()
+            : std::string();
+
+    // A checkpoint holds the whole frame, which neither local processes nor pipelined renders produce at once.
+    if ((pipelined || !cli_path.empty()) &&
+        (renderer_settings.m_enable_checkpoint || renderer_settings.m_resume_from_checkpoint))
+    {
+        RENDERER_LOG_WARNING("checkpoints are not supported with pipelined rendering or local render processes.");
+        renderer_settings.m_enable_checkpoint = false;
+        renderer_settings.m_resume_from_checkpoint = false;
+    }
+
     MaterialMap material_map;
+    LightEmittingMtlMap light_emitting_mtl_map;
     ObjectMap object_map;
     ObjectInstanceMap object_inst_map;
     AssemblyMap assembly_map;
     AssemblyInstanceMap assembly_inst_map;
+    LightMap light_map;
     asf::auto_release_ptr<asr::Project> project(
         build_project(
             m_entities,
@@ -2224,8 +2545,11 @@ int AppleseedRenderer::Render(
             object_map,
             object_inst_map,
             material_map,
+            light_emitting_mtl_map,
             assembly_map,
-            assembly_inst_map));
+            assembly_inst_map,
+            light_map,
+            !pipelined));
 
     if (m_rend_params.inMtlEdit)
     {
@@ -2235,15 +2559,15 @@ int AppleseedRenderer::Render(
         // Render the project.
         if (progress_cb)
             progress_cb->SetTitle(L"Rendering...");
-        render(project.ref(), m_settings, bitmap, progress_cb);
+        render(project.ref(), renderer_settings, bitmap, progress_cb);
     }
     else
     {
-        // Write the project to disk.
+        // Write the project to disk, while rendering if the project is also rendered.
+        std::unique_ptr<BackgroundProjectWriter> project_writer;
         if (!m_settings.m_use_max_procedural_maps)
         {
-            if (m_settings.m_output_mode == RendererSettings::OutputMode::SaveProjectOnly ||
-                m_settings.m_output_mode == RendererSettings::OutputMode::SaveProjectAndRender)
+            if (m_settings.m_output_mode == RendererSettings::OutputMode::SaveProjectOnly)
             {
                 if (progress_cb)
                     progress_cb->SetTitle(L"Writing Project To Disk...");
@@ -2251,6 +2575,13 @@ int AppleseedRenderer::Render(
                     project.ref(),
                     wide_to_utf8(m_settings.m_project_file_path).c_str());
             }
+            else if (m_settings.m_output_mode == RendererSettings::OutputMode::SaveProjectAndRender)
+            {
+                project_writer.reset(
+                    new BackgroundProjectWriter(
+                        project.ref(),
+                        wide_to_utf8(m_settings.m_project_file_path)));
+            }
         }
 
         // Render the project.
@@ -2270,26 +2601,59 @@ int AppleseedRenderer::Render(
             auto render_status = asr::IRendererController::Status::ContinueRendering;
 
             if (progress_cb)
-                progress_cb->SetTitle(L"Rendering...");
+                progress_cb->SetTitle(pipelined ? L"Building Project And Rendering..." : L"Rendering...");
 
+            std::unique_ptr<asf::ProcessPriorityContext> background_context;
             if (m_settings.m_low_priority_mode)
             {
-                asf::ProcessPriorityContext background_context(
-                    asf::ProcessPriority::ProcessPriorityLow,
-                    &asr::global_logger());
-                render_status = render(project.ref(), m_settings, bitmap, progress_cb);
+                background_context.reset(
+                    new asf::ProcessPriorityContext(
+                        asf::ProcessPriority::ProcessPriorityLow,
+                        &asr::global_logger()));
+            }
+
+            if (pipelined)
+            {
+                render_status =
+                    render_pipelined(
+                        project.ref(),
+                        m_entities.m_objects,
+                        renderer_settings,
+                        bitmap,
+                        time,
+                        material_map,
+                        light_emitting_mtl_map,
+                        progress_cb);
+            }
+            else if (!cli_path.empty() && can_render_with_local_processes(project.ref()))
+            {
+                render_status =
+                    render_with_local_processes(
+                        project.ref(),
+                        cli_path,
+                        static_cast<size_t>(local_process_count),
+                        bitmap,
+                        progress_cb);
             }
             else
             {
-                render_status = render(project.ref(), m_settings, bitmap, progress_cb);
+                render_status = render(project.ref(), renderer_settings, bitmap, progress_cb, project_writer.get());
             }
 
             if (render_status != asr::IRendererController::Status::AbortRendering &&
                 !GetCOREInterface14()->GetRendUseIterative())
                 project->get_frame()->write_main_and_aov_images();
 
+            // Only an aborted render can be resumed, later renders must not resume from a completed one.
+            if (render_status != asr::IRendererController::Status::AbortRendering)
+                delete_checkpoint(renderer_settings, time);
+
             BroadcastNotification(NOTIFY_POST_RENDERFRAME, &render_context);
         }
+
+        // The project must not be released while it is still being written.
+        if (project_writer)
+            project_writer->wait(progress_cb);
     }
 
     if (progress_cb)
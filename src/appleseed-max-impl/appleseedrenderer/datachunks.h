@@ -56,6 +56,10 @@ const USHORT ChunkSettingsAdaptiveTileMaxSamples                    = 0x1163;
 const USHORT ChunkSettingsAdaptiveTileNoiseThreshold                = 0x1164;
 const USHORT ChunkSettingsNoiseSeed                                 = 0x1165;
 const USHORT ChunkSettingsEnableNoiseSeed                           = 0x1166;
+const USHORT ChunkSettingsEnableCheckpoint                          = 0x1167;
+const USHORT ChunkSettingsResumeFromCheckpoint                      = 0x1168;
+const USHORT ChunkSettingsRenderTimeLimit                           = 0x1169;
+const USHORT ChunkSettingsRenderNoiseTarget                         = 0x116A;
 
 const USHORT ChunkSettingsPathtracer                                = 0x1200;
 const USHORT ChunkSettingsPathtracerGI                              = 0x1210;
@@ -0,0 +1,431 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2020 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Interface header.
+#include "localprocessrenderer.h"
+
+// appleseed-max headers.
+#include "appleseedrenderer/projectbuilder.h"
+#include "appleseedrenderer/tilecallback.h"
+#include "utilities.h"
+
+// Build options header.
+#include "foundation/core/buildoptions.h"
+
+// appleseed.renderer headers.
+#include "renderer/api/frame.h"
+#include "renderer/api/log.h"
+#include "renderer/api/project.h"
+#include "renderer/api/scene.h"
+#include "renderer/api/shadergroup.h"
+
+// appleseed.foundation headers.
+#include "foundation/core/exceptions/exception.h"
+#include "foundation/image/canvasproperties.h"
+#include "foundation/image/color.h"
+#include "foundation/image/genericimagefilereader.h"
+#include "foundation/image/image.h"
+#include "foundation/math/aabb.h"
+#include "foundation/platform/atomic.h"
+#include "foundation/platform/windows.h"
+#include "foundation/string/string.h"
+
+// 3ds Max headers.
+#include "appleseed-max-common/_beginmaxheaders.h"
+#include <render.h>
+#include "appleseed-max-common/_endmaxheaders.h"
+
+// Boost headers.
+#include "boost/filesystem.hpp"
+
+// Standard headers.
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace asf = foundation;
+namespace asr = renderer;
+namespace bf = boost::filesystem;
+
+namespace
+{
+    const size_t NoNumaNode = ~size_t(0);
+
+    struct Band
+    {
+        size_t                  m_tile_y_begin;
+        size_t                  m_tile_y_end;
+        asf::AABB2u             m_window;           // pixels rendered by this band
+        std::string             m_output_path;
+        PROCESS_INFORMATION     m_process;
+    };
+
+    std::wstring quote(const std::string& arg)
+    {
+        return L"\"" + utf8_to_wide(arg) + L"\"";
+    }
+
+    bool start_process(
+        std::wstring            command_line,
+        const size_t            numa_node,
+        PROCESS_INFORMATION&    process)
+    {
+        STARTUPINFOEXW startup_info = {};
+        startup_info.StartupInfo.cb = sizeof(startup_info);
+        DWORD flags = CREATE_NO_WINDOW | BELOW_NORMAL_PRIORITY_CLASS;
+
+        // Spread processes over NUMA nodes so that each one allocates its memory locally.
+        std::vector<std::uint8_t> attribute_list_storage;
+        USHORT node = static_cast<USHORT>(numa_node);
+        if (numa_node != NoNumaNode)
+        {
+            SIZE_T attribute_list_size = 0;
+            InitializeProcThreadAttributeList(nullptr, 1, 0, &attribute_list_size);
+            attribute_list_storage.resize(attribute_list_size);
+            const LPPROC_THREAD_ATTRIBUTE_LIST attribute_list =
+                reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(&attribute_list_storage[0]);
+
+            if (InitializeProcThreadAttributeList(attribute_list, 1, 0, &attribute_list_size))
+            {
+                startup_info.lpAttributeList = attribute_list;
+
+                if (UpdateProcThreadAttribute(
+                        attribute_list,
+                        0,
+                        PROC_THREAD_ATTRIBUTE_PREFERRED_NODE,
+                        &node,
+                        sizeof(node),
+                        nullptr,
+                        nullptr))
+                    flags |= EXTENDED_STARTUPINFO_PRESENT;
+            }
+        }
+
+        const BOOL success =
+            CreateProcessW(
+                nullptr,
+                &command_line[0],
+                nullptr,
+                nullptr,
+                FALSE,
+                flags,
+                nullptr,
+                nullptr,
+                &startup_info.StartupInfo,
+                &process);
+
+        if (startup_info.lpAttributeList != nullptr)
+            DeleteProcThreadAttributeList(startup_info.lpAttributeList);
+
+        return success != FALSE;
+    }
+
+    // Copy the band rendered by a process into the frame and hand its tiles over to the tile callback.
+    bool collect_band(
+        const Band&             band,
+        asr::Frame&             frame,
+        TileCallback&           tile_callback)
+    {
+        std::unique_ptr<asf::Image> band_image;
+        try
+        {
+            asf::GenericImageFileReader reader;
+            band_image.reset(reader.read(band.m_output_path.c_str()));
+        }
+        catch (const asf::Exception& e)
+        {
+            RENDERER_LOG_ERROR("failed to read %s: %s", band.m_output_path.c_str(), e.what());
+            return false;
+        }
+
+        asf::Image& image = frame.image();
+        const asf::CanvasProperties& props = image.properties();
+        const asf::CanvasProperties& band_props = band_image->properties();
+
+        if (band_props.m_canvas_width != props.m_canvas_width ||
+            band_props.m_canvas_height != props.m_canvas_height)
+        {
+            RENDERER_LOG_ERROR("%s does not have the resolution of the frame.", band.m_output_path.c_str());
+            return false;
+        }
+
+        for (size_t y = band.m_window.min.y; y <= band.m_window.max.y; ++y)
+        {
+            for (size_t x = band.m_window.min.x; x <= band.m_window.max.x; ++x)
+            {
+                asf::Color4f color;
+                band_image->get_pixel(x, y, color);
+                image.set_pixel(x, y, color);
+            }
+        }
+
+        for (size_t tile_y = band.m_tile_y_begin; tile_y < band.m_tile_y_end; ++tile_y)
+        {
+            for (size_t tile_x = 0; tile_x < props.m_tile_count_x; ++tile_x)
+            {
+                tile_callback.on_tile_begin(&frame, tile_x, tile_y, 0, 1);
+                tile_callback.on_tile_end(&frame, tile_x, tile_y);
+            }
+        }
+
+        return true;
+    }
+
+    bool find_shaders(
+        const asr::BaseGroup&       base_group,
+        const std::vector<std::string>& search_paths,
+        std::set<std::string>&      checked_shaders)
+    {
+        for (const auto& shader_group : base_group.shader_groups())
+        {
+            for (const auto& shader : shader_group.shaders())
+            {
+                bf::path shader_filename(shader.get_shader());
+                if (shader_filename.extension() != ".oso")
+                    shader_filename += ".oso";
+
+                if (!checked_shaders.insert(shader_filename.string()).second)
+                    continue;
+
+                boost::system::error_code ec;
+                const bool found =
+                    std::any_of(
+                        search_paths.begin(),
+                        search_paths.end(),
+                        [&shader_filename, &ec](const std::string& dir) { return bf::exists(bf::path(dir) / shader_filename, ec); });
+
+                if (!found)
+                {
+                    RENDERER_LOG_WARNING("appleseed.cli processes can't find shader %s.", shader_filename.string().c_str());
+                    return false;
+                }
+            }
+        }
+
+        for (const auto& assembly : base_group.assemblies())
+        {
+            if (!find_shaders(assembly, search_paths, checked_shaders))
+                return false;
+        }
+
+        return true;
+    }
+}
+
+std::string find_appleseed_cli()
+{
+    const bf::path cli_path = bf::path(get_root_path()) / "appleseed.cli.exe";
+
+    boost::system::error_code ec;
+    if (!bf::exists(cli_path, ec))
+    {
+        RENDERER_LOG_WARNING("could not find %s.", cli_path.string().c_str());
+        return std::string();
+    }
+
+    return cli_path.string();
+}
+
+bool can_render_with_local_processes(const asr::Project& project)
+{
+    // Processes load the project from another directory, they only know of the absolute search paths it is written with.
+    std::set<std::string> checked_shaders;
+    if (!find_shaders(*project.get_scene(), get_absolute_search_paths(project.search_paths()), checked_shaders))
+    {
+        RENDERER_LOG_WARNING("rendering in process instead of with local render processes.");
+        return false;
+    }
+
+    return true;
+}
+
+asr::IRendererController::Status render_with_local_processes(
+    asr::Project&           project,
+    const std::string&      cli_path,
+    const size_t            process_count,
+    Bitmap*                 bitmap,
+    RendProgressCallback*   progress_cb)
+{
+    asr::Frame& frame = *project.get_frame();
+    const asf::CanvasProperties& props = frame.image().properties();
+    const asf::AABB2u& crop_window = frame.get_crop_window();
+
+    // Write the project once, all processes render from the same project file.
+    const bf::path working_dir =
+        bf::temp_directory_path() / bf::unique_path("appleseed-max-%%%%-%%%%-%%%%");
+    boost::system::error_code ec;
+    bf::create_directories(working_dir, ec);
+
+    // The project still belongs to the caller, write it without modifying it.
+    const std::string project_path = (working_dir / "project.appleseed").string();
+    std::vector<GeometryFile> geometry_files;
+    if (!write_project_file(project, project_path, geometry_files) ||
+        !write_geometry_files(geometry_files))
+    {
+        bf::remove_all(working_dir, ec);
+        return asr::IRendererController::AbortRendering;
+    }
+
+    // Split the frame into horizontal bands of whole tile rows.
+    // WaitForMultipleObjects() can't wait for more than MAXIMUM_WAIT_OBJECTS processes.
+    const size_t band_count =
+        std::min({ process_count, props.m_tile_count_y, static_cast<size_t>(MAXIMUM_WAIT_OBJECTS) });
+    std::vector<Band> bands;
+    for (size_t i = 0; i < band_count; ++i)
+    {
+        Band band;
+        band.m_tile_y_begin = i * props.m_tile_count_y / band_count;
+        band.m_tile_y_end = (i + 1) * props.m_tile_count_y / band_count;
+        band.m_window.min.x = crop_window.min.x;
+        band.m_window.max.x = crop_window.max.x;
+        band.m_window.min.y = std::max(band.m_tile_y_begin * props.m_tile_height, crop_window.min.y);
+        band.m_window.max.y = std::min(band.m_tile_y_end * props.m_tile_height - 1, crop_window.max.y);
+        band.m_output_path = (working_dir / ("band_" + std::to_string(i) + ".exr")).string();
+        band.m_process = {};
+
+        if (band.m_window.min.y <= band.m_window.max.y)
+            bands.push_back(band);
+    }
+
+    // Share hardware threads and NUMA nodes among processes.
+    ULONG highest_numa_node = 0;
+    GetNumaHighestNodeNumber(&highest_numa_node);
+    const size_t numa_node_count = static_cast<size_t>(highest_numa_node) + 1;
+    const size_t thread_count =
+        std::max<size_t>(std::thread::hardware_concurrency() / std::max<size_t>(bands.size(), 1), 1);
+
+    // Number of rendered tiles, shared counter accessed atomically.
+    volatile std::uint32_t rendered_tile_count = 0;
+    TileCallback tile_callback(bitmap, &rendered_tile_count);
+
+    std::vector<HANDLE> running;
+    std::vector<Band*> running_bands;
+    for (size_t i = 0; i < bands.size(); ++i)
+    {
+        Band& band = bands[i];
+
+        const std::wstring command_line =
+              quote(cli_path)
+            + L" " + quote(project_path)
+            + L" --output " + quote(band.m_output_path)
+            + L" --window "
+                + std::to_wstring(band.m_window.min.x) + L" "
+                + std::to_wstring(band.m_window.min.y) + L" "
+                + std::to_wstring(band.m_window.max.x) + L" "
+                + std::to_wstring(band.m_window.max.y)
+            + L" --threads " + std::to_wstring(thread_count)
+            + L" --message-verbosity warning";
+
+        if (!start_process(command_line, numa_node_count > 1 ? i % numa_node_count : NoNumaNode, band.m_process))
+        {
+            RENDERER_LOG_ERROR("failed to start %s.", cli_path.c_str());
+            continue;
+        }
+
+        RENDERER_LOG_INFO(
+            "rendering pixel rows %s to %s in process %s.",
+            asf::pretty_uint(band.m_window.min.y).c_str(),
+            asf::pretty_uint(band.m_window.max.y).c_str(),
+            asf::pretty_uint(band.m_process.dwProcessId).c_str());
+
+        running.push_back(band.m_process.hProcess);
+        running_bands.push_back(&band);
+    }
+
+    // Wait for processes to complete, displaying their bands as they come in.
+    auto status = asr::IRendererController::ContinueRendering;
+    size_t failed_band_count = bands.size() - running.size();
+    const int total_tile_count = static_cast<int>(props.m_tile_count);
+    while (!running.empty())
+    {
+        const DWORD result =
+            WaitForMultipleObjects(
+                static_cast<DWORD>(running.size()),
+                &running[0],
+                FALSE,
+                100);
+
+        if (result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + running.size())
+        {
+            const size_t index = result - WAIT_OBJECT_0;
+            Band& band = *running_bands[index];
+
+            // A crashing process only costs its own band.
+            DWORD exit_code = 1;
+            GetExitCodeProcess(band.m_process.hProcess, &exit_code);
+            if (exit_code != 0)
+            {
+                RENDERER_LOG_ERROR(
+                    "process %s exited with code %s.",
+                    asf::pretty_uint(band.m_process.dwProcessId).c_str(),
+                    asf::pretty_uint(exit_code).c_str());
+                ++failed_band_count;
+            }
+            else if (!collect_band(band, frame, tile_callback))
+                ++failed_band_count;
+
+            CloseHandle(band.m_process.hProcess);
+            CloseHandle(band.m_process.hThread);
+            running.erase(running.begin() + index);
+            running_bands.erase(running_bands.begin() + index);
+        }
+
+        const int done = static_cast<int>(asf::atomic_read(&rendered_tile_count));
+        if (progress_cb && progress_cb->Progress(done, total_tile_count) == RENDPROG_ABORT)
+        {
+            status = asr::IRendererController::AbortRendering;
+            for (Band* band : running_bands)
+            {
+                TerminateProcess(band->m_process.hProcess, 1);
+                WaitForSingleObject(band->m_process.hProcess, INFINITE);
+                CloseHandle(band->m_process.hProcess);
+                CloseHandle(band->m_process.hThread);
+            }
+            running.clear();
+            running_bands.clear();
+        }
+    }
+
+    if (failed_band_count > 0)
+    {
+        RENDERER_LOG_ERROR(
+            "%s of %s bands failed to render.",
+            asf::pretty_uint(failed_band_count).c_str(),
+            asf::pretty_uint(bands.size()).c_str());
+
+        if (failed_band_count == bands.size())
+            status = asr::IRendererController::AbortRendering;
+    }
+
+    bf::remove_all(working_dir, ec);
+
+    return status;
+}
@@ -0,0 +1,58 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2020 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+// Build options header.
+#include "foundation/core/buildoptions.h"
+
+// appleseed.renderer headers.
+#include "renderer/api/rendering.h"
+
+// Standard headers.
+#include <cstddef>
+#include <string>
+
+// Forward declarations.
+namespace renderer  { class Project; }
+class Bitmap;
+class RendProgressCallback;
+
+// Return the path to the appleseed.cli executable shipped alongside the plugin, or an empty string if it can't be found.
+std::string find_appleseed_cli();
+
+// Return true if appleseed.cli processes would find all the shaders of a project, and render it as 3ds Max would.
+bool can_render_with_local_processes(const renderer::Project& project);
+
+// Render a project with several local appleseed.cli processes, each rendering a horizontal band of the frame.
+// Bands are copied into the frame of the project and displayed as soon as their process completes.
+renderer::IRendererController::Status render_with_local_processes(
+    renderer::Project&                  project,
+    const std::string&                  cli_path,
+    const size_t                        process_count,
+    Bitmap*                             bitmap,
+    RendProgressCallback*               progress_cb);
@@ -0,0 +1,783 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2020 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Interface header.
+#include "materialcache.h"
+
+// appleseed-max headers.
+#include "utilities.h"
+
+// Build options header.
+#include "foundation/core/buildoptions.h"
+
+// appleseed.renderer headers.
+#include "renderer/api/bsdf.h"
+#include "renderer/api/bssrdf.h"
+#include "renderer/api/color.h"
+#include "renderer/api/edf.h"
+#include "renderer/api/material.h"
+#include "renderer/api/scene.h"
+#include "renderer/api/shadergroup.h"
+#include "renderer/api/texture.h"
+#include "renderer/api/volume.h"
+
+// appleseed.foundation headers.
+#include "foundation/containers/dictionary.h"
+#include "foundation/string/string.h"
+#include "foundation/utility/searchpaths.h"
+
+// 3ds Max headers.
+#include "appleseed-max-common/_beginmaxheaders.h"
+#include <imtl.h>
+#include <max.h>
+#include <notify.h>
+#include <ref.h>
+#include "appleseed-max-common/_endmaxheaders.h"
+
+// Standard headers.
+#include <cstring>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace asf = foundation;
+namespace asr = renderer;
+
+//
+// A weak reference to a 3ds Max material holding the material's translation.
+//
+
+class MtlWatcher
+  : public ReferenceMaker
+{
+  public:
+    MtlWatcher(
+        Mtl*                                        mtl,
+        const std::string&                          material_name,
+        const bool                                  use_max_procedural_maps,
+        const Interval&                             validity,
+        asf::auto_release_ptr<asr::Assembly>        bundle)
+      : m_mtl(nullptr)
+      , m_material_name(material_name)
+      , m_use_max_procedural_maps(use_max_procedural_maps)
+      , m_validity(validity)
+      , m_bundle(bundle)
+      , m_valid(true)
+    {
+        ReplaceReference(0, mtl);
+    }
+
+    bool is_valid() const
+    {
+        return m_valid && m_mtl != nullptr;
+    }
+
+    bool matches(
+        const std::string&                          material_name,
+        const bool                                  use_max_procedural_maps,
+        const TimeValue                             time) const
+    {
+        return
+            is_valid() &&
+            m_material_name == material_name &&
+            m_use_max_procedural_maps == use_max_procedural_maps &&
+            m_validity.InInterval(time);
+    }
+
+    const asr::Assembly* get_bundle() const
+    {
+        return m_bundle.get();
+    }
+
+    int NumRefs() override
+    {
+        return 1;
+    }
+
+    RefTargetHandle GetReference(int i) override
+    {
+        return m_mtl;
+    }
+
+    BOOL IsRealDependency(ReferenceTarget* rtarg) override
+    {
+        // Don't keep the material alive and don't let it appear as used.
+        return FALSE;
+    }
+
+    RefResult NotifyRefChanged(
+        const Interval&                             changeInt,
+        RefTargetHandle                             hTarget,
+        PartID&                                     partID,
+        RefMessage                                  message,
+        BOOL                                        propagate) override
+    {
+        switch (message)
+        {
+          case REFMSG_CHANGE:
+          case REFMSG_SUBANIM_STRUCTURE_CHANGED:
+          case REFMSG_TARGET_DELETED:
+            m_valid = false;
+            break;
+        }
+
+        return REF_DONTCARE;
+    }
+
+  protected:
+    void SetReference(int i, RefTargetHandle rtarg) override
+    {
+        m_mtl = static_cast<Mtl*>(rtarg);
+    }
+
+  private:
+    Mtl*                                            m_mtl;
+    const std::string                               m_material_name;
+    const bool                                      m_use_max_procedural_maps;
+    const Interval                                  m_validity;
+    asf::auto_release_ptr<asr::Assembly>            m_bundle;
+    bool                                            m_valid;
+};
+
+namespace
+{
+    void delete_watcher(MtlWatcher* watcher)
+    {
+        watcher->DeleteAllRefsFromMe();
+        delete watcher;
+    }
+
+    template <typename Registrar, typename EntityContainer>
+    void copy_entities(
+        const Registrar&                            registrar,
+        const EntityContainer&                      src,
+        EntityContainer&                            dst)
+    {
+        for (const auto& entity : src)
+        {
+            if (dst.get_by_name(entity.get_name()) != nullptr)
+                continue;
+
+            dst.insert(
+                registrar.lookup(entity.get_model())->create(
+                    entity.get_name(),
+                    entity.get_parameters()));
+        }
+    }
+
+    template <typename EntityContainer>
+    void move_entities(
+        EntityContainer&                            src,
+        EntityContainer&                            dst)
+    {
+        while (src.size() > 0)
+        {
+            auto entity = src.remove(src.get_by_index(0));
+            if (dst.get_by_name(entity->get_name()) == nullptr)
+                dst.insert(entity);
+        }
+    }
+
+    // Collect the string values of a dictionary and of its nested dictionaries, some of which name other entities.
+    void collect_references(
+        const asf::Dictionary&                      params,
+        std::vector<std::string>&                   names)
+    {
+        for (auto i = params.strings().begin(), e = params.strings().end(); i != e; ++i)
+            names.push_back(i.value());
+
+        for (auto i = params.dictionaries().begin(), e = params.dictionaries().end(); i != e; ++i)
+            collect_references(i.value(), names);
+    }
+
+    template <typename EntityContainer>
+    bool collect_entity_references(
+        const EntityContainer&                      container,
+        const std::string&                          name,
+        std::vector<std::string>&                   names)
+    {
+        const auto entity = container.get_by_name(name.c_str());
+        if (entity == nullptr)
+            return false;
+
+        collect_references(entity->get_parameters(), names);
+        return true;
+    }
+
+    // Return the names of the entities of an assembly that a material uses, directly or through other entities.
+    std::set<std::string> get_material_dependencies(
+        const asr::Assembly&                        assembly,
+        const asr::Material&                        material)
+    {
+        std::set<std::string> dependencies;
+        std::vector<std::string> pending;
+        collect_references(material.get_parameters(), pending);
+
+        while (!pending.empty())
+        {
+            const std::string name = pending.back();
+            pending.pop_back();
+
+            if (!dependencies.insert(name).second)
+                continue;
+
+            const asr::TextureInstance* texture_instance = assembly.texture_instances().get_by_name(name.c_str());
+            if (texture_instance != nullptr)
+            {
+                collect_references(texture_instance->get_parameters(), pending);
+                pending.push_back(texture_instance->get_texture_name());
+                continue;
+            }
+
+            collect_entity_references(assembly.colors(), name, pending) ||
+            collect_entity_references(assembly.textures(), name, pending) ||
+            collect_entity_references(assembly.shader_groups(), name, pending) ||
+            collect_entity_references(assembly.bsdfs(), name, pending) ||
+            collect_entity_references(assembly.bssrdfs(), name, pending) ||
+            collect_entity_references(assembly.edfs(), name, pending) ||
+            collect_entity_references(assembly.volumes(), name, pending);
+        }
+
+        return dependencies;
+    }
+
+    template <typename EntityContainer>
+    void remove_entities(
+        const std::set<std::string>&                names,
+        EntityContainer&                            container)
+    {
+        for (const std::string& name : names)
+        {
+            auto entity = container.get_by_name(name.c_str());
+            if (entity != nullptr)
+                container.remove(entity);
+        }
+    }
+
+    bool has_single_shader_group(const asr::Assembly& bundle)
+    {
+        return
+            bundle.colors().size() == 0 &&
+            bundle.textures().size() == 0 &&
+            bundle.texture_instances().size() == 0 &&
+            bundle.bsdfs().size() == 0 &&
+            bundle.bssrdfs().size() == 0 &&
+            bundle.edfs().size() == 0 &&
+            bundle.volumes().size() == 0 &&
+            bundle.materials().size() == 0 &&
+            bundle.shader_groups().size() == 1;
+    }
+
+    bool is_disk_texture(const asr::Texture& texture)
+    {
+        return std::strcmp(texture.get_model(), asr::DiskTexture2dFactory().get_model()) == 0;
+    }
+
+    typedef std::map<std::string, std::string> ShaderGroupRenames;
+
+    void rename_shader_group(asr::ParamArray& params, const ShaderGroupRenames& renames)
+    {
+        if (!params.strings().exist("osl_surface"))
+            return;
+
+        const auto it = renames.find(params.get("osl_surface"));
+        if (it != renames.end())
+            params.insert("osl_surface", it->second);
+    }
+
+    // If `include_values` is false, only the first word of each value is kept, which is the type of OSL parameters.
+    void append_dictionary(
+        std::string&                                contents,
+        const asf::Dictionary&                      dictionary,
+        const bool                                  include_values = true)
+    {
+        // Sort entries by key so that equal dictionaries always produce the same string.
+        std::map<std::string, std::string> strings;
+        for (auto i = dictionary.strings().begin(), e = dictionary.strings().end(); i != e; ++i)
+        {
+            const std::string value = i.value();
+            strings[i.key()] = include_values ? value : value.substr(0, value.find(' '));
+        }
+
+        for (const auto& entry : strings)
+            contents += entry.first + '=' + entry.second + ';';
+
+        std::map<std::string, const asf::Dictionary*> dictionaries;
+        for (auto i = dictionary.dictionaries().begin(), e = dictionary.dictionaries().end(); i != e; ++i)
+            dictionaries[i.key()] = &i.value();
+
+        for (const auto& entry : dictionaries)
+        {
+            contents += entry.first + "={";
+            append_dictionary(contents, *entry.second, include_values);
+            contents += "};";
+        }
+    }
+
+    // Return a textual representation of a shader group that doesn't depend on the names of its layers.
+    // If `include_values` is false, the values of shader parameters are left out.
+    std::string get_shader_group_contents(
+        const asr::ShaderGroup&                     shader_group,
+        const bool                                  include_values = true)
+    {
+        std::map<std::string, std::string> layer_ids;
+        for (const auto& shader : shader_group.shaders())
+            layer_ids.insert(std::make_pair(shader.get_layer(), asf::to_string(layer_ids.size())));
+
+        auto get_layer_id = [&layer_ids](const char* layer)
+        {
+            const auto it = layer_ids.find(layer);
+            return it != layer_ids.end() ? it->second : std::string(layer);
+        };
+
+        std::string contents;
+        append_dictionary(contents, shader_group.get_parameters());
+        contents += '\n';
+
+        for (const auto& shader : shader_group.shaders())
+        {
+            contents += "shader ";
+            contents += shader.get_type();
+            contents += ' ';
+            contents += shader.get_shader();
+            contents += ' ';
+            contents += get_layer_id(shader.get_layer());
+            contents += ' ';
+            append_dictionary(contents, shader.get_parameters(), include_values);
+            contents += '\n';
+        }
+
+        for (const auto& conn : shader_group.shader_connections())
+        {
+            contents += "connect ";
+            contents += get_layer_id(conn.get_src_layer());
+            contents += ' ';
+            contents += conn.get_src_param();
+            contents += ' ';
+            contents += get_layer_id(conn.get_dst_layer());
+            contents += ' ';
+            contents += conn.get_dst_param();
+            contents += '\n';
+        }
+
+        return contents;
+    }
+
+    // Return true if a shader group identical to a given one was already merged, and which one.
+    bool find_identical_shader_group(
+        ShaderGroupIndex*                           shader_group_index,
+        const asr::ShaderGroup&                     shader_group,
+        ShaderGroupRenames&                         renames)
+    {
+        if (shader_group_index == nullptr)
+            return false;
+
+        const std::string* existing_name = shader_group_index->find_or_insert(shader_group);
+        if (existing_name == nullptr)
+            return false;
+
+        renames[shader_group.get_name()] = *existing_name;
+        return true;
+    }
+}
+
+
+//
+// MaterialCache class implementation.
+//
+
+MaterialCache::MaterialCache()
+{
+    // Entries hold references to 3ds Max materials: release them while 3ds Max is still alive.
+    RegisterNotification(&MaterialCache::on_system_shutdown, this, NOTIFY_SYSTEM_SHUTDOWN);
+}
+
+MaterialCache::~MaterialCache()
+{
+    clear();
+}
+
+const asr::Assembly* MaterialCache::lookup(
+    Mtl*                                            mtl,
+    const std::string&                              material_name,
+    const bool                                      use_max_procedural_maps,
+    const TimeValue                                 time)
+{
+    if (!is_usable())
+        return nullptr;
+
+    const auto it = m_entries.find(mtl);
+    if (it == m_entries.end() || !it->second->matches(material_name, use_max_procedural_maps, time))
+        return nullptr;
+
+    return it->second->get_bundle();
+}
+
+void MaterialCache::insert(
+    Mtl*                                            mtl,
+    const std::string&                              material_name,
+    const bool                                      use_max_procedural_maps,
+    const TimeValue                                 time,
+    asf::auto_release_ptr<asr::Assembly>            bundle)
+{
+    if (!is_usable())
+        return;
+
+    const auto it = m_entries.find(mtl);
+    if (it != m_entries.end())
+    {
+        delete_watcher(it->second);
+        m_entries.erase(it);
+    }
+
+    m_entries.insert(
+        std::make_pair(
+            mtl,
+            new MtlWatcher(
+                mtl,
+                material_name,
+                use_max_procedural_maps,
+                mtl->Validity(time),
+                bundle)));
+}
+
+bool MaterialCache::is_usable() const
+{
+    // The reference system of 3ds Max may only be used from the thread that owns the main window.
+    const HWND main_window = GetCOREInterface()->GetMAXHWnd();
+    return GetWindowThreadProcessId(main_window, nullptr) == GetCurrentThreadId();
+}
+
+void MaterialCache::clear()
+{
+    for (const auto& entry : m_entries)
+        delete_watcher(entry.second);
+
+    m_entries.clear();
+}
+
+void MaterialCache::purge_invalid_entries()
+{
+    if (!is_usable())
+        return;
+
+    for (auto it = m_entries.begin(); it != m_entries.end(); )
+    {
+        if (it->second->is_valid())
+            ++it;
+        else
+        {
+            delete_watcher(it->second);
+            it = m_entries.erase(it);
+        }
+    }
+}
+
+void MaterialCache::on_system_shutdown(void* param, NotifyInfo* info)
+{
+    MaterialCache* cache = static_cast<MaterialCache*>(param);
+    UnRegisterNotification(&MaterialCache::on_system_shutdown, cache, NOTIFY_SYSTEM_SHUTDOWN);
+    cache->clear();
+}
+
+MaterialCache& get_material_cache()
+{
+    static MaterialCache material_cache;
+    return material_cache;
+}
+
+
+//
+// ShaderGroupIndex class implementation.
+//
+
+const std::string* ShaderGroupIndex::find_or_insert(const asr::ShaderGroup& shader_group)
+{
+    const auto result =
+        m_shader_groups.insert(
+            std::make_pair(
+                get_shader_group_contents(shader_group),
+                std::string(shader_group.get_name())));
+
+    if (result.second)
+        return nullptr;
+
+    ++m_shared_count;
+    return &result.first->second;
+}
+
+size_t ShaderGroupIndex::get_shared_count() const
+{
+    return m_shared_count;
+}
+
+
+//
+// Material bundle functions implementation.
+//
+
+bool is_cacheable_material_bundle(const asr::Assembly& bundle)
+{
+    // Textures that are not disk textures (e.g. 3ds Max procedural maps) can't be recreated from their parameters.
+    for (const auto& texture : bundle.textures())
+    {
+        if (!is_disk_texture(texture))
+            return false;
+    }
+
+    return true;
+}
+
+void copy_material_bundle(
+    const asr::Assembly&                            bundle,
+    asr::Assembly&                                  assembly,
+    ShaderGroupIndex*                               shader_group_index)
+{
+    for (const auto& color : bundle.colors())
+    {
+        if (assembly.colors().get_by_name(color.get_name()) == nullptr)
+            assembly.colors().insert(asr::ColorEntityFactory::create(color.get_name(), color.get_parameters()));
+    }
+
+    for (const auto& texture : bundle.textures())
+    {
+        if (assembly.textures().get_by_name(texture.get_name()) == nullptr)
+        {
+            assembly.textures().insert(
+                asr::DiskTexture2dFactory().create(
+                    texture.get_name(),
+                    texture.get_parameters(),
+                    asf::SearchPaths()));
+        }
+    }
+
+    for (const auto& texture_instance : bundle.texture_instances())
+    {
+        if (assembly.texture_instances().get_by_name(texture_instance.get_name()) == nullptr)
+        {
+            assembly.texture_instances().insert(
+                asr::TextureInstanceFactory::create(
+                    texture_instance.get_name(),
+                    texture_instance.get_parameters(),
+                    texture_instance.get_texture_name()));
+        }
+    }
+
+    ShaderGroupRenames shader_group_renames;
+
+    for (const auto& src_group : bundle.shader_groups())
+    {
+        if (assembly.shader_groups().get_by_name(src_group.get_name()) != nullptr)
+            continue;
+
+        if (find_identical_shader_group(shader_group_index, src_group, shader_group_renames))
+            continue;
+
+        auto shader_group = asr::ShaderGroupFactory::create(src_group.get_name(), src_group.get_parameters());
+
+        for (const auto& shader : src_group.shaders())
+            shader_group->add_shader(shader.get_type(), shader.get_shader(), shader.get_layer(), shader.get_parameters());
+
+        for (const auto& conn : src_group.shader_connections())
+            shader_group->add_connection(conn.get_src_layer(), conn.get_src_param(), conn.get_dst_layer(), conn.get_dst_param());
+
+        assembly.shader_groups().insert(shader_group);
+    }
+
+    static const asr::BSDFFactoryRegistrar bsdf_factory_registrar;
+    static const asr::BSSRDFFactoryRegistrar bssrdf_factory_registrar;
+    static const asr::EDFFactoryRegistrar edf_factory_registrar;
+    static const asr::VolumeFactoryRegistrar volume_factory_registrar;
+    static const asr::MaterialFactoryRegistrar material_factory_registrar;
+
+    copy_entities(bsdf_factory_registrar, bundle.bsdfs(), assembly.bsdfs());
+    copy_entities(bssrdf_factory_registrar, bundle.bssrdfs(), assembly.bssrdfs());
+    copy_entities(edf_factory_registrar, bundle.edfs(), assembly.edfs());
+    copy_entities(volume_factory_registrar, bundle.volumes(), assembly.volumes());
+
+    for (const auto& material : bundle.materials())
+    {
+        if (assembly.materials().get_by_name(material.get_name()) != nullptr)
+            continue;
+
+        asr::ParamArray params = material.get_parameters();
+        rename_shader_group(params, shader_group_renames);
+
+        assembly.materials().insert(
+            material_factory_registrar.lookup(material.get_model())->create(
+                material.get_name(),
+                params));
+    }
+}
+
+void move_material_bundle(
+    asr::Assembly&                                  bundle,
+    asr::Assembly&                                  assembly,
+    ShaderGroupIndex*                               shader_group_index)
+{
+    ShaderGroupRenames shader_group_renames;
+
+    for (const auto& shader_group : bundle.shader_groups())
+        find_identical_shader_group(shader_group_index, shader_group, shader_group_renames);
+
+    for (const auto& rename : shader_group_renames)
+        bundle.shader_groups().remove(bundle.shader_groups().get_by_name(rename.first.c_str()));
+
+    for (auto& material : bundle.materials())
+        rename_shader_group(material.get_parameters(), shader_group_renames);
+
+    move_entities(bundle.colors(), assembly.colors());
+    move_entities(bundle.textures(), assembly.textures());
+    move_entities(bundle.texture_instances(), assembly.texture_instances());
+    move_entities(bundle.shader_groups(), assembly.shader_groups());
+    move_entities(bundle.bsdfs(), assembly.bsdfs());
+    move_entities(bundle.bssrdfs(), assembly.bssrdfs());
+    move_entities(bundle.edfs(), assembly.edfs());
+    move_entities(bundle.volumes(), assembly.volumes());
+    move_entities(bundle.materials(), assembly.materials());
+}
+
+bool patch_material(
+    asr::Assembly&                                  assembly,
+    const asr::Material&                            material,
+    asr::Assembly&                                  bundle)
+{
+    asr::Material* live_material = assembly.materials().get_by_name(material.get_name());
+    if (live_material == nullptr || std::strcmp(live_material->get_model(), material.get_model()) != 0)
+        return false;
+
+    if (!has_single_shader_group(bundle))
+        return false;
+
+    asr::ParamArray& live_params = live_material->get_parameters();
+    if (!live_params.strings().exist("osl_surface"))
+        return false;
+
+    const std::string live_group_name = live_params.get("osl_surface");
+    const asr::ShaderGroup* live_group = assembly.shader_groups().get_by_name(live_group_name.c_str());
+    asr::ShaderGroup* new_group = bundle.shader_groups().get_by_index(0);
+    if (live_group == nullptr)
+        return false;
+
+    // Both materials must be identical but for the name of their shader group.
+    asr::ParamArray params = material.get_parameters();
+    params.insert("osl_surface", live_group_name);
+    std::string live_material_contents, material_contents;
+    append_dictionary(live_material_contents, live_params);
+    append_dictionary(material_contents, params);
+    if (live_material_contents != material_contents)
+        return false;
+
+    // Both shader groups must have the same shaders, parameters and connections.
+    if (get_shader_group_contents(*live_group, false) != get_shader_group_contents(*new_group, false))
+        return false;
+
+    // Nothing to do if no parameter value changed either.
+    if (get_shader_group_contents(*live_group) == get_shader_group_contents(*new_group))
+        return true;
+
+    // Point the live material to the new shader group.
+    const std::string group_name = make_unique_name(assembly.shader_groups(), new_group->get_name());
+    asf::auto_release_ptr<asr::ShaderGroup> shader_group = bundle.shader_groups().remove(new_group);
+    shader_group->set_name(group_name.c_str());
+    assembly.shader_groups().insert(shader_group);
+    live_params.insert("osl_surface", group_name);
+    live_material->bump_version_id();
+
+    // Remove the previous shader group unless it is shared with other materials.
+    for (const auto& other_material : assembly.materials())
+    {
+        const asr::ParamArray& other_params = other_material.get_parameters();
+        if (other_params.strings().exist("osl_surface") && live_group_name == other_params.get("osl_surface"))
+            return true;
+    }
+
+    assembly.shader_groups().remove(assembly.shader_groups().get_by_name(live_group_name.c_str()));
+
+    return true;
+}
+
+void replace_material_bundle(
+    asr::Assembly&                                  bundle,
+    asr::Assembly&                                  assembly)
+{
+    // Remove the previous translations along with the entities that no other material uses. Entities may be
+    // shared with other materials by name, or by contents in the case of shader groups.
+    for (const auto& material : bundle.materials())
+    {
+        asr::Material* live_material = assembly.materials().get_by_name(material.get_name());
+        if (live_material == nullptr)
+            continue;
+
+        std::set<std::string> owned_entities = get_material_dependencies(assembly, *live_material);
+        for (const auto& other_material : assembly.materials())
+        {
+            if (&other_material != live_material)
+            {
+                for (const std::string& name : get_material_dependencies(assembly, other_material))
+                    owned_entities.erase(name);
+            }
+        }
+
+        assembly.materials().remove(live_material);
+
+        remove_entities(owned_entities, assembly.colors());
+        remove_entities(owned_entities, assembly.textures());
+        remove_entities(owned_entities, assembly.texture_instances());
+        remove_entities(owned_entities, assembly.shader_groups());
+        remove_entities(owned_entities, assembly.bsdfs());
+        remove_entities(owned_entities, assembly.bssrdfs());
+        remove_entities(owned_entities, assembly.edfs());
+        remove_entities(owned_entities, assembly.volumes());
+    }
+
+    // Shader groups of other materials may still have the names of the new ones: give the new ones unique names,
+    // as patch_material() does, so that other materials keep their shading.
+    ShaderGroupRenames shader_group_renames;
+    for (size_t i = 0; i < bundle.shader_groups().size(); )
+    {
+        asr::ShaderGroup* shader_group = bundle.shader_groups().get_by_index(i);
+        if (assembly.shader_groups().get_by_name(shader_group->get_name()) == nullptr)
+        {
+            ++i;
+            continue;
+        }
+
+        const std::string group_name = make_unique_name(assembly.shader_groups(), shader_group->get_name());
+        shader_group_renames[shader_group->get_name()] = group_name;
+
+        asf::auto_release_ptr<asr::ShaderGroup> renamed_group = bundle.shader_groups().remove(shader_group);
+        renamed_group->set_name(group_name.c_str());
+        assembly.shader_groups().insert(renamed_group);
+    }
+
+    for (auto& material : bundle.materials())
+        rename_shader_group(material.get_parameters(), shader_group_renames);
+
+    // Other entities left in the assembly are shared by name, and keep their place.
+    move_material_bundle(bundle, assembly);
+}
@@ -0,0 +1,163 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2020 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+// Build options header.
+#include "foundation/core/buildoptions.h"
+
+// appleseed.foundation headers.
+#include "foundation/memory/autoreleaseptr.h"
+
+// 3ds Max headers.
+#include "appleseed-max-common/_beginmaxheaders.h"
+#include <maxtypes.h>
+#include "appleseed-max-common/_endmaxheaders.h"
+
+// Standard headers.
+#include <cstddef>
+#include <map>
+#include <string>
+
+// Forward declarations.
+namespace renderer  { class Assembly; }
+namespace renderer  { class Material; }
+namespace renderer  { class ShaderGroup; }
+class Mtl;
+class MtlWatcher;
+struct NotifyInfo;
+
+//
+// Persistent cache of material translations.
+//
+// Each entry holds the bundle of appleseed entities (colors, textures, shader groups,
+// BSDFs, etc.) produced by IAppleseedMtl::create_material() for a given 3ds Max material.
+// Entries are invalidated when the material (or any of its maps or sub-materials) changes,
+// when it is deleted, or when the requested time falls outside of the material's validity
+// interval. The cache is owned by and must only be used from 3ds Max's main thread.
+//
+
+class MaterialCache
+{
+  public:
+    MaterialCache();
+    ~MaterialCache();
+
+    // Return the cached bundle for a given material, or nullptr if there is none or if it is stale.
+    // The bundle remains alive until the next call to purge_invalid_entries(), insert() for the same material, or clear().
+    const renderer::Assembly* lookup(
+        Mtl*                                        mtl,
+        const std::string&                          material_name,
+        const bool                                  use_max_procedural_maps,
+        const TimeValue                             time);
+
+    // Store the bundle of a given material. Any previous entry for this material is replaced.
+    void insert(
+        Mtl*                                        mtl,
+        const std::string&                          material_name,
+        const bool                                  use_max_procedural_maps,
+        const TimeValue                             time,
+        foundation::auto_release_ptr<renderer::Assembly> bundle);
+
+    // Return true if the cache can be used from the calling thread.
+    bool is_usable() const;
+
+    // Remove the entries of materials that changed or were deleted since they were inserted.
+    void purge_invalid_entries();
+
+    // Remove all entries.
+    void clear();
+
+  private:
+    std::map<Mtl*, MtlWatcher*>                     m_entries;
+
+    static void on_system_shutdown(void* param, NotifyInfo* info);
+};
+
+// Return the process-wide material cache.
+MaterialCache& get_material_cache();
+
+
+//
+// Index of the shader groups merged into an assembly, by contents.
+//
+// Materials whose shader groups only differ by the names of their layers (for instance
+// copies of the same material) end up sharing a single shader group, which means OSL
+// only has to optimize and compile it once per render. The index only lives as long as
+// the merge; shader groups are recreated, optimized and compiled again on every render.
+//
+
+class ShaderGroupIndex
+{
+  public:
+    // Return the name of a previously indexed shader group identical to a given one,
+    // or index the given shader group and return nullptr if there is none.
+    const std::string* find_or_insert(const renderer::ShaderGroup& shader_group);
+
+    // Return the number of shader groups that were found to be identical to an indexed one.
+    size_t get_shared_count() const;
+
+  private:
+    std::map<std::string, std::string>              m_shader_groups;    // contents -> name
+    size_t                                          m_shared_count = 0;
+};
+
+// Return true if all entities of a material bundle can be recreated from their parameters.
+bool is_cacheable_material_bundle(const renderer::Assembly& bundle);
+
+// Insert copies of all entities of a material bundle into a given assembly.
+// Entities whose name already exists in the destination assembly are skipped.
+// If a shader group index is provided, identical shader groups are shared.
+void copy_material_bundle(
+    const renderer::Assembly&                       bundle,
+    renderer::Assembly&                             assembly,
+    ShaderGroupIndex*                               shader_group_index = nullptr);
+
+// Move all entities of a material bundle into a given assembly.
+// Entities whose name already exists in the destination assembly are skipped.
+// If a shader group index is provided, identical shader groups are shared.
+void move_material_bundle(
+    renderer::Assembly&                             bundle,
+    renderer::Assembly&                             assembly,
+    ShaderGroupIndex*                               shader_group_index = nullptr);
+
+// Apply a new translation of a material, created in a bundle, to the material of the same name
+// in a given assembly, provided that they only differ by the values of their shader parameters.
+// Only the shader group of the existing material is replaced. Return false, leaving the assembly
+// untouched, if the two translations differ in any other way.
+bool patch_material(
+    renderer::Assembly&                             assembly,
+    const renderer::Material&                       material,
+    renderer::Assembly&                             bundle);
+
+// Replace the materials of a given assembly that have the same names as the ones of a bundle
+// by their new translation. Entities of the previous translations that no other material uses
+// are removed. Shader groups of the bundle are renamed if other materials still use their names,
+// then all entities of the bundle are moved into the assembly.
+void replace_material_bundle(
+    renderer::Assembly&                             bundle,
+    renderer::Assembly&                             assembly);
@@ -35,6 +35,7 @@
 #include "appleseedobjpropsmod/appleseedobjpropsmod.h"
 #include "appleseedoslplugin/oslmaterial.h"
 #include "appleseedrenderelement/appleseedrenderelement.h"
+#include "appleseedrenderer/materialcache.h"
 #include "appleseedrenderer/maxsceneentities.h"
 #include "utilities.h"
 
@@ -55,6 +56,7 @@
 #include "renderer/api/environmentshader.h"
 #include "renderer/api/frame.h"
 #include "renderer/api/light.h"
+#include "renderer/api/log.h"
 #include "renderer/api/material.h"
 #include "renderer/api/object.h"
 #include "renderer/api/postprocessing.h"
@@ -62,6 +64,7 @@
 #include "renderer/api/scene.h"
 #include "renderer/api/texture.h"
 #include "renderer/api/utility.h"
+#include "renderer/utility/plugin/pluginstore.h"
 
 // appleseed.foundation headers.
 #include "foundation/containers/dictionary.h"
@@ -71,6 +74,7 @@
 #include "foundation/math/scalar.h"
 #include "foundation/math/transform.h"
 #include "foundation/math/vector.h"
+#include "foundation/string/string.h"
 #include "foundation/utility/iostreamop.h"
 #include "foundation/utility/searchpaths.h"
 
@@ -83,6 +87,7 @@
 #include <INodeTab.h>
 #include <MeshNormalSpec.h>
 #include <modstack.h>
+#include <notify.h>
 #include <object.h>
 #include <pbbitmap.h>
 #include <renderelements.h>
@@ -91,15 +96,24 @@
 #include <triobj.h>
 #include "appleseed-max-common/_endmaxheaders.h"
 
+// Boost headers.
+#include "boost/filesystem.hpp"
+
 // Standard headers.
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
 namespace asf = foundation;
 namespace asr = renderer;
+namespace bf = boost::filesystem;
 
 namespace
 {
@@ -476,6 +490,46 @@ namespace
         int         m_sides;    // sides of the object to which the material must be applied
     };
 
+    asf::auto_release_ptr<asr::Assembly> translate_material(
+        IAppleseedMtl*          appleseed_mtl,
+        const std::string&      material_name,
+        const bool              use_max_procedural_maps,
+        const TimeValue         time)
+    {
+        asf::auto_release_ptr<asr::Assembly> bundle(
+            asr::AssemblyFactory().create((material_name + "_bundle").c_str()));
+
+        asf::auto_release_ptr<asr::Material> material =
+            appleseed_mtl->create_material(
+                bundle.ref(),
+                material_name.c_str(),
+                use_max_procedural_maps,
+                time);
+        // todo: handle material creation errors.
+        bundle->materials().insert(material);
+
+        return bundle;
+    }
+
+    void insert_material_bundle(
+        asr::Assembly&          assembly,
+        Mtl*                    mtl,
+        const std::string&      material_name,
+        const bool              use_max_procedural_maps,
+        const TimeValue         time,
+        asf::auto_release_ptr<asr::Assembly> bundle,
+        ShaderGroupIndex*       shader_group_index = nullptr)
+    {
+        MaterialCache& material_cache = get_material_cache();
+
+        if (material_cache.is_usable() && is_cacheable_material_bundle(bundle.ref()))
+        {
+            copy_material_bundle(bundle.ref(), assembly, shader_group_index);
+            material_cache.insert(mtl, material_name, use_max_procedural_maps, time, bundle);
+        }
+        else move_material_bundle(bundle.ref(), assembly, shader_group_index);
+    }
+
     MaterialInfo get_or_create_material(
         asr::Assembly&          parent_assembly,
         const std::string&      instance_name,
@@ -494,17 +548,31 @@ namespace
             const auto it = material_map.find(mtl);
             if (it == material_map.end())
             {
-                // The appleseed material does not exist yet, let the material plugin create it.
+                // The appleseed material does not exist yet.
                 material_info.m_name =
                     make_unique_name(parent_assembly.materials(), wide_to_utf8(mtl->GetName()) + "_mat");
-                asf::auto_release_ptr<asr::Material> material =
-                    appleseed_mtl->create_material(
+
+                MaterialCache& material_cache = get_material_cache();
+                const asr::Assembly* cached_bundle =
+                    material_cache.lookup(mtl, material_info.m_name, use_max_procedural_maps, time);
+
+                if (cached_bundle != nullptr)
+                {
+                    // The material did not change since it was last translated: reuse its translation.
+                    copy_material_bundle(*cached_bundle, parent_assembly);
+                }
+                else
+                {
+                    // Let the material plugin create the material into a standalone bundle.
+                    insert_material_bundle(
                         parent_assembly,
-                        material_info.m_name.c_str(),
+                        mtl,
+                        material_info.m_name,
                         use_max_procedural_maps,
-                        time);
-                // todo: handle material creation errors.
-                parent_assembly.materials().insert(material);
+                        time,
+                        translate_material(appleseed_mtl, material_info.m_name, use_max_procedural_maps, time));
+                }
+
                 material_map.insert(std::make_pair(mtl, material_info.m_name));
             }
             else
@@ -633,12 +701,19 @@ namespace
         return shadow_terminator_correction;
     }
 
-    bool is_light_emitting_material(Mtl* mtl)
+    bool is_light_emitting_material(Mtl* mtl, LightEmittingMtlMap& light_emitting_mtl_map)
     {
+        // Results are memoized per material, including for sub-materials.
+        const auto it = light_emitting_mtl_map.find(mtl);
+        if (it != light_emitting_mtl_map.end())
+            return it->second;
+
+        bool is_light_emitting = false;
+
         IAppleseedMtl* appleseed_mtl =
             static_cast<IAppleseedMtl*>(mtl->GetInterface(IAppleseedMtl::interface_id()));
         if (appleseed_mtl != nullptr && appleseed_mtl->can_emit_light())
-            return true;
+            is_light_emitting = true;
         else
         {
             const int submtl_count = mtl->NumSubMtls();
@@ -647,12 +722,17 @@ namespace
                 Mtl* sub_mtl = mtl->GetSubMtl(i);
                 if (sub_mtl != nullptr)
                 {
-                    if (is_light_emitting_material(sub_mtl))
-                        return true;
+                    if (is_light_emitting_material(sub_mtl, light_emitting_mtl_map))
+                    {
+                        is_light_emitting = true;
+                        break;
+                    }
                 }
             }
         }
-        return false;
+
+        light_emitting_mtl_map.insert(std::make_pair(mtl, is_light_emitting));
+        return is_light_emitting;
     }
 
     bool is_glass_material(Mtl* mtl)
@@ -660,7 +740,10 @@ namespace
         return mtl != nullptr && mtl->ClassID() == AppleseedGlassMtl::get_class_id();
     }
 
-    Mtl* override_material(Mtl* mtl, const RendererSettings& settings)
+    Mtl* override_material(
+        Mtl*                    mtl,
+        const RendererSettings& settings,
+        LightEmittingMtlMap&    light_emitting_mtl_map)
     {
         if (mtl == nullptr)
             return settings.m_override_material;
@@ -668,7 +751,7 @@ namespace
         if (settings.m_enable_override_material &&
             settings.m_override_material != nullptr)
         {
-            if (is_light_emitting_material(mtl))
+            if (is_light_emitting_material(mtl, light_emitting_mtl_map))
             {
                 if (settings.m_override_exclude_light_materials)
                     return mtl;
@@ -717,7 +800,8 @@ namespace
         const RendererSettings& settings,
         const TimeValue         time,
         ObjectInstanceMap&      obj_instance_map,
-        MaterialMap&            material_map)
+        MaterialMap&            material_map,
+        LightEmittingMtlMap&    light_emitting_mtl_map)
     {
         // Compute a unique name for this instance.
         const std::string instance_name =
@@ -748,7 +832,7 @@ namespace
                     Mtl* submtl = mtl->GetSubMtl(i);
 
                     if (type != RenderType::MaterialPreview)
-                        submtl = override_material(submtl, settings);
+                        submtl = override_material(submtl, settings, light_emitting_mtl_map);
 
                     if (submtl != nullptr)
                     {
@@ -778,7 +862,7 @@ namespace
                 // It's a single material.
 
                 if (type != RenderType::MaterialPreview)
-                    mtl = override_material(mtl, settings);
+                    mtl = override_material(mtl, settings, light_emitting_mtl_map);
 
                 // Create the appleseed material.
                 const auto material_info =
@@ -806,7 +890,7 @@ namespace
             // The instance does not have a material.
 
             if (type != RenderType::MaterialPreview)
-                mtl = override_material(mtl, settings);
+                mtl = override_material(mtl, settings, light_emitting_mtl_map);
 
             // Create a new default material.
             const std::string material_name =
@@ -857,6 +941,172 @@ namespace
         obj_instance_map[wide_to_utf8(instance_node->GetName())] = assembly.object_instances().get_by_index(instance_index);
     }
 
+    // Collect the materials that create_object_instance() will retrieve for a given node.
+    void collect_node_materials(
+        INode*                  node,
+        const RendererSettings& settings,
+        LightEmittingMtlMap&    light_emitting_mtl_map,
+        std::vector<Mtl*>&      mtls)
+    {
+        Mtl* mtl = node->GetMtl();
+        if (mtl == nullptr)
+            return;
+
+        const int submtl_count = mtl->NumSubMtls();
+        if (mtl->IsMultiMtl() && submtl_count > 0)
+        {
+            for (int i = 0; i < submtl_count; ++i)
+            {
+                Mtl* submtl = override_material(mtl->GetSubMtl(i), settings, light_emitting_mtl_map);
+                if (submtl != nullptr)
+                    mtls.push_back(submtl);
+            }
+        }
+        else mtls.push_back(override_material(mtl, settings, light_emitting_mtl_map));
+    }
+
+    // Bring a material and all its sub-materials and maps up-to-date.
+    void update_material_recursively(Mtl* mtl, const TimeValue time)
+    {
+        mtl->Update(time, FOREVER);
+        load_map_files_recursively(mtl, time);
+
+        for (int i = 0, e = mtl->NumSubMtls(); i < e; ++i)
+        {
+            Mtl* sub_mtl = mtl->GetSubMtl(i);
+            if (sub_mtl != nullptr)
+                update_material_recursively(sub_mtl, time);
+        }
+    }
+
+    std::string reserve_material_name(
+        const asr::Assembly&    assembly,
+        std::set<std::string>&  reserved_names,
+        const std::string&      name)
+    {
+        std::string unique_name = make_unique_name(assembly.materials(), name);
+
+        for (size_t i = 1; reserved_names.find(unique_name) != reserved_names.end(); ++i)
+            unique_name = make_unique_name(assembly.materials(), name + "_" + asf::to_string(i));
+
+        reserved_names.insert(unique_name);
+        return unique_name;
+    }
+
+    // A material used by the scene, discovered but not merged into the assembly yet.
+    struct PendingMaterial
+    {
+        Mtl*                    m_mtl;
+        IAppleseedMtl*          m_appleseed_mtl;
+        std::string             m_name;
+        const asr::Assembly*    m_cached_bundle;    // translation from a previous render, if any
+        asr::Assembly*          m_bundle;           // new translation, owned here until merged
+    };
+
+    void translate_materials(
+        asr::Assembly&          assembly,
+        const MaxSceneEntities& entities,
+        const RendererSettings& settings,
+        const TimeValue         time,
+        MaterialMap&            material_map,
+        LightEmittingMtlMap&    light_emitting_mtl_map)
+    {
+        // Discover the set of unique appleseed materials used by the scene.
+        std::vector<Mtl*> mtls;
+        for (const auto& object : entities.m_objects)
+            collect_node_materials(object, settings, light_emitting_mtl_map, mtls);
+
+        // Cached bundles are only released here, so that the ones looked up below remain alive during the batch.
+        MaterialCache& material_cache = get_material_cache();
+        material_cache.purge_invalid_entries();
+
+        std::set<std::string> reserved_names;
+        std::vector<PendingMaterial> pending_materials;
+        size_t translated_count = 0;
+
+        for (Mtl* mtl : mtls)
+        {
+            if (material_map.find(mtl) != material_map.end())
+                continue;
+
+            auto appleseed_mtl =
+                static_cast<IAppleseedMtl*>(mtl->GetInterface(IAppleseedMtl::interface_id()));
+            if (appleseed_mtl == nullptr)
+                continue;
+
+            PendingMaterial pending;
+            pending.m_mtl = mtl;
+            pending.m_appleseed_mtl = appleseed_mtl;
+            pending.m_name = reserve_material_name(assembly, reserved_names, wide_to_utf8(mtl->GetName()) + "_mat");
+            pending.m_cached_bundle = material_cache.lookup(mtl, pending.m_name, settings.m_use_max_procedural_maps, time);
+            pending.m_bundle = nullptr;
+
+            if (pending.m_cached_bundle == nullptr)
+                update_material_recursively(mtl, time);
+
+            is_light_emitting_material(mtl, light_emitting_mtl_map);
+
+            material_map.insert(std::make_pair(mtl, pending.m_name));
+            pending_materials.push_back(pending);
+        }
+
+        // Translate materials that are not cached, each into its own bundle. Material plugins read
+        // parameter blocks and evaluate controllers and maps, which is only safe on the main thread.
+        for (auto& pending : pending_materials)
+        {
+            if (pending.m_cached_bundle == nullptr)
+            {
+                pending.m_bundle =
+                    translate_material(
+                        pending.m_appleseed_mtl,
+                        pending.m_name,
+                        settings.m_use_max_procedural_maps,
+                        time).release();
+                ++translated_count;
+            }
+        }
+
+        // Merge all bundles into the assembly, in discovery order, sharing identical shader groups.
+        ShaderGroupIndex shader_group_index;
+        for (auto& pending : pending_materials)
+        {
+            // Updating or translating other materials may have changed maps shared with this one since it was looked up.
+            if (pending.m_cached_bundle != nullptr &&
+                material_cache.lookup(pending.m_mtl, pending.m_name, settings.m_use_max_procedural_maps, time) == nullptr)
+            {
+                update_material_recursively(pending.m_mtl, time);
+                pending.m_cached_bundle = nullptr;
+                pending.m_bundle =
+                    translate_material(
+                        pending.m_appleseed_mtl,
+                        pending.m_name,
+                        settings.m_use_max_procedural_maps,
+                        time).release();
+                ++translated_count;
+            }
+
+            if (pending.m_cached_bundle != nullptr)
+                copy_material_bundle(*pending.m_cached_bundle, assembly, &shader_group_index);
+            else
+            {
+                insert_material_bundle(
+                    assembly,
+                    pending.m_mtl,
+                    pending.m_name,
+                    settings.m_use_max_procedural_maps,
+                    time,
+                    asf::auto_release_ptr<asr::Assembly>(pending.m_bundle),
+                    &shader_group_index);
+            }
+        }
+
+        RENDERER_LOG_INFO(
+            "translated %s material(s), reused %s cached material(s), shared %s identical shader group(s).",
+            asf::pretty_uint(translated_count).c_str(),
+            asf::pretty_uint(pending_materials.size() - translated_count).c_str(),
+            asf::pretty_uint(shader_group_index.get_shared_count()).c_str());
+    }
+
     void add_objects(
         asr::Project&           project,
         asr::Assembly&          assembly,
@@ -867,10 +1117,19 @@ namespace
         ObjectMap&              object_map,
         ObjectInstanceMap&      object_inst_map,
         MaterialMap&            material_map,
+        LightEmittingMtlMap&    light_emitting_mtl_map,
         AssemblyMap&            assembly_map,
         AssemblyInstanceMap&    assembly_inst_map,
-        RendProgressCallback*   progress_cb)
+        RendProgressCallback*   progress_cb,
+        const bool              include_objects)
     {
+        // Translate all materials upfront so that object instances only need to look them up.
+        if (type != RenderType::MaterialPreview)
+            translate_materials(assembly, entities, settings, time, material_map, light_emitting_mtl_map);
+
+        if (!include_objects)
+            return;
+
         for (size_t i = 0, e = entities.m_objects.size(); i < e; ++i)
         {
             const auto& object = entities.m_objects[i];
@@ -884,6 +1143,7 @@ namespace
                 object_map,
                 object_inst_map,
                 material_map,
+                light_emitting_mtl_map,
                 assembly_map,
                 assembly_inst_map);
 
@@ -988,7 +1248,8 @@ namespace
         asr::Assembly&          assembly,
         const RendParams&       rend_params,
         INode*                  light_node,
-        const TimeValue         time)
+        const TimeValue         time,
+        LightMap&               light_map)
     {
         // Retrieve the ObjectState at the desired time.
         const ObjectState object_state = light_node->EvalWorldState(time);
@@ -1087,6 +1348,14 @@ namespace
                 // Unsupported light type.
                 // todo: emit warning message.
             }
+
+            // Remember which entities were created for this light.
+            if (assembly.lights().get_by_name(light_name.c_str()) != nullptr)
+            {
+                LightInfo& light_info = light_map[wide_to_utf8(light_node->GetName())];
+                light_info.m_light_name = light_name;
+                light_info.m_color_name = color_name;
+            }
         }
     }
 
@@ -1094,12 +1363,13 @@ namespace
         asr::Assembly&          assembly,
         const RendParams&       rend_params,
         const MaxSceneEntities& entities,
-        const TimeValue         time)
+        const TimeValue         time,
+        LightMap&               light_map)
     {
         for (const auto& light_info : entities.m_lights)
         {
             if (light_info.m_enabled)
-                add_light(assembly, rend_params, light_info.m_light, time);
+                add_light(assembly, rend_params, light_info.m_light, time, light_map);
         }
     }
 
@@ -1184,12 +1454,14 @@ namespace
         }
     }
 
-    bool has_light_emitting_materials(const MaterialMap& material_map)
+    bool has_light_emitting_materials(
+        const MaterialMap&      material_map,
+        LightEmittingMtlMap&    light_emitting_mtl_map)
     {
         for (const auto& entry : material_map)
         {
             Mtl* mtl = entry.first;
-            if (is_light_emitting_material(mtl))
+            if (is_light_emitting_material(mtl, light_emitting_mtl_map))
                 return true;
         }
 
@@ -1211,8 +1483,11 @@ namespace
         ObjectMap&                          object_map,
         ObjectInstanceMap&                  object_inst_map,
         MaterialMap&                        material_map,
+        LightEmittingMtlMap&                light_emitting_mtl_map,
         AssemblyMap&                        assembly_map,
-        AssemblyInstanceMap&                assembly_inst_map)
+        AssemblyInstanceMap&                assembly_inst_map,
+        LightMap&                           light_map,
+        const bool                          include_objects)
     {
         // Add objects, object instances and materials to the assembly.
         add_objects(
@@ -1225,12 +1500,14 @@ namespace
             object_map,
             object_inst_map,
             material_map,
+            light_emitting_mtl_map,
             assembly_map,
             assembly_inst_map,
-            progress_cb);
+            progress_cb,
+            include_objects);
 
         // Only add non-physical lights. Light-emitting materials were added by material plugins.
-        add_lights(assembly, rend_params, entities, time);
+        add_lights(assembly, rend_params, entities, time, light_map);
 
         // Add Max's default lights if
         //       the scene does not contain non-physical lights (point lights, spot lights, etc.)
@@ -1238,7 +1515,7 @@ namespace
         //   and the scene does not contain a light-emitting environment
         //   and checkbox Force Off Default Lights is off
         const bool has_lights = !entities.m_lights.empty();
-        const bool has_emitting_mats = has_light_emitting_materials(material_map);
+        const bool has_emitting_mats = has_light_emitting_materials(material_map, light_emitting_mtl_map);
         const bool has_emitting_env = !scene.get_environment()->get_parameters().get_optional<std::string>("environment_edf").empty();
         if (rend_params.inMtlEdit ||
             (!has_lights &&
@@ -1541,12 +1818,73 @@ namespace
         }
     }
 
+    // Return the path of the checkpoint file of a frame of final renders, next to the saved image or project file.
+    // Each frame of an animation has its own checkpoint, so that a frame only ever resumes from its own one.
+    std::string get_checkpoint_path(
+        const RendererSettings& settings,
+        const TimeValue         time)
+    {
+        bf::path path;
+        if (GetCOREInterface()->GetRendSaveFile() && GetCOREInterface()->GetRendFileBI().Name()[0] != L'\0')
+            path = wide_to_utf8(GetCOREInterface()->GetRendFileBI().Name());
+        else if (!settings.m_project_file_path.empty())
+            path = wide_to_utf8(settings.m_project_file_path);
+        else return std::string();
+
+        const int frame_number = static_cast<int>(time) / GetTicksPerFrame();
+        path.replace_extension("." + asf::to_string(frame_number) + ".checkpoint.exr");
+        return path.string();
+    }
+
+    void set_checkpoint_params(
+        asr::ParamArray&        params,
+        const RendererSettings& settings,
+        const TimeValue         time)
+    {
+        // Checkpoints store the accumulation buffers of the frame and of its AOVs at the end of each pass.
+        if (settings.m_passes < 2)
+            return;
+
+        const std::string checkpoint_path = get_checkpoint_path(settings, time);
+        if (checkpoint_path.empty())
+        {
+            RENDERER_LOG_WARNING("checkpoints require the rendered image or the project to be saved to a file.");
+            return;
+        }
+
+        if (settings.m_resume_from_checkpoint)
+        {
+            boost::system::error_code ec;
+            if (bf::exists(checkpoint_path, ec))
+            {
+                RENDERER_LOG_INFO("resuming rendering from checkpoint %s.", checkpoint_path.c_str());
+                params.insert("checkpoint_resume", true);
+                params.insert("checkpoint_resume_path", checkpoint_path);
+            }
+            else RENDERER_LOG_INFO("no checkpoint found at %s, rendering from scratch.", checkpoint_path.c_str());
+        }
+
+        if (settings.m_enable_checkpoint)
+        {
+            RENDERER_LOG_INFO("writing a checkpoint to %s after each pass.", checkpoint_path.c_str());
+            params.insert("checkpoint_create", true);
+            params.insert("checkpoint_create_path", checkpoint_path);
+        }
+    }
+
     asf::auto_release_ptr<asr::Frame> build_frame(
         const RendParams&       rend_params,
         const FrameRendParams&  frame_rend_params,
         Bitmap*                 bitmap,
-        const RendererSettings& settings)
+        const RendererSettings& settings,
+        const TimeValue         time,
+        const size_t            resolution_divisor = 1)
     {
+        // Round up so that the frame covers the whole bitmap once upscaled.
+        const asf::Vector2i resolution(
+            std::max((bitmap->Width() + static_cast<int>(resolution_divisor) - 1) / static_cast<int>(resolution_divisor), 1),
+            std::max((bitmap->Height() + static_cast<int>(resolution_divisor) - 1) / static_cast<int>(resolution_divisor), 1));
+
         if (rend_params.inMtlEdit)
         {
             return
@@ -1554,7 +1892,7 @@ namespace
                     "beauty",
                     asr::ParamArray()
                         .insert("camera", "camera")
-                        .insert("resolution", asf::Vector2i(bitmap->Width(), bitmap->Height()))
+                        .insert("resolution", resolution)
                         .insert("tile_size", asf::Vector2i(8, 8))
                         .insert("filter", "box")
                         .insert("filter_size", 0.5));
@@ -1599,23 +1937,29 @@ namespace
                 }
             }
 
+            asr::ParamArray frame_params;
+            frame_params
+                .insert("camera", "camera")
+                .insert("resolution", resolution)
+                .insert("tile_size", asf::Vector2i(settings.m_tile_size))
+                .insert("filter", get_filter_type(settings.m_pixel_filter))
+                .insert("filter_size", settings.m_pixel_filter_size)
+                .insert("denoiser", get_denoise_mode(settings.m_denoise_mode))
+                .insert("skip_denoised", settings.m_enable_skip_denoised)
+                .insert("prefilter_spikes", settings.m_enable_prefilter_spikes)
+                .insert("random_pixel_order", settings.m_enable_random_pixel_order)
+                .insert("patch_distance_threshold", settings.m_patch_distance_threshold)
+                .insert("spike_threshold", settings.m_spike_threshold)
+                .insert("denoise_scales", settings.m_denoise_scales)
+                .insert("noise_seed", settings.m_noise_seed);
+
+            if (settings.m_enable_checkpoint || settings.m_resume_from_checkpoint)
+                set_checkpoint_params(frame_params, settings, time);
+
             asf::auto_release_ptr<asr::Frame> frame(
                 asr::FrameFactory::create(
                     "beauty",
-                    asr::ParamArray()
-                        .insert("camera", "camera")
-                        .insert("resolution", asf::Vector2i(bitmap->Width(), bitmap->Height()))
-                        .insert("tile_size", asf::Vector2i(settings.m_tile_size))
-                        .insert("filter", get_filter_type(settings.m_pixel_filter))
-                        .insert("filter_size", settings.m_pixel_filter_size)
-                        .insert("denoiser", get_denoise_mode(settings.m_denoise_mode))
-                        .insert("skip_denoised", settings.m_enable_skip_denoised)
-                        .insert("prefilter_spikes", settings.m_enable_prefilter_spikes)
-                        .insert("random_pixel_order", settings.m_enable_random_pixel_order)
-                        .insert("patch_distance_threshold", settings.m_patch_distance_threshold)
-                        .insert("spike_threshold", settings.m_spike_threshold)
-                        .insert("denoise_scales", settings.m_denoise_scales)
-                        .insert("noise_seed", settings.m_noise_seed),
+                    frame_params,
                     aovs));
 
             if (rend_params.rendType == RENDTYPE_REGION)
@@ -1639,6 +1983,150 @@ namespace
             return frame;
         }
     }
+
+    // Process-wide cache of renderer plugins. Search paths are only scanned when they change,
+    // and plugins stay loaded between renders instead of being loaded again for every project.
+    struct PluginCache
+    {
+        std::mutex                          m_mutex;
+        std::string                         m_search_paths;     // search paths of the last scan
+        std::vector<std::string>            m_plugin_paths;     // plugins found by the last scan
+        std::unique_ptr<asr::PluginStore>   m_plugin_store;     // keeps plugins loaded
+
+        PluginCache()
+        {
+            // Unload plugins while 3ds Max is still alive, not during static destruction inside the loader lock.
+            RegisterNotification(&PluginCache::on_system_shutdown, this, NOTIFY_SYSTEM_SHUTDOWN);
+        }
+
+        static void on_system_shutdown(void* param, NotifyInfo* info)
+        {
+            PluginCache* cache = static_cast<PluginCache*>(param);
+            UnRegisterNotification(&PluginCache::on_system_shutdown, cache, NOTIFY_SYSTEM_SHUTDOWN);
+
+            std::lock_guard<std::mutex> lock(cache->m_mutex);
+            cache->m_plugin_store.reset();
+            cache->m_plugin_paths.clear();
+            cache->m_search_paths.clear();
+        }
+    };
+
+    PluginCache& get_plugin_cache()
+    {
+        static PluginCache plugin_cache;
+        return plugin_cache;
+    }
+
+    std::vector<std::string> find_plugins(const asf::SearchPaths& search_paths)
+    {
+        std::vector<std::string> plugin_paths;
+
+        for (const std::string& dir : get_absolute_search_paths(search_paths))
+        {
+            const bf::path dir_path(dir);
+
+            try
+            {
+                if (!bf::exists(dir_path) || !bf::is_directory(dir_path))
+                    continue;
+
+                for (bf::directory_iterator it(dir_path), e; it != e; ++it)
+                {
+                    if (it->status().type() == bf::regular_file && it->path().extension() == ".dll")
+                        plugin_paths.push_back(it->path().string());
+                }
+            }
+            catch (const bf::filesystem_error& e)
+            {
+                RENDERER_LOG_ERROR(
+                    "filesystem error, path = %s, error = %s.",
+                    dir_path.string().c_str(),
+                    e.what());
+            }
+        }
+
+        return plugin_paths;
+    }
+
+    void load_plugins(asr::Project& project)
+    {
+        const std::string search_paths = project.search_paths().to_string(';').c_str();
+
+        std::vector<std::string> plugin_paths;
+
+        {
+            PluginCache& plugin_cache = get_plugin_cache();
+            std::lock_guard<std::mutex> lock(plugin_cache.m_mutex);
+
+            if (plugin_cache.m_plugin_store == nullptr || plugin_cache.m_search_paths != search_paths)
+            {
+                RENDERER_LOG_DEBUG("scanning search paths %s for plugins...", search_paths.c_str());
+
+                plugin_cache.m_search_paths = search_paths;
+                plugin_cache.m_plugin_paths = find_plugins(project.search_paths());
+                plugin_cache.m_plugin_store.reset(new asr::PluginStore());
+
+                for (const std::string& plugin_path : plugin_cache.m_plugin_paths)
+                    plugin_cache.m_plugin_store->load_plugin(plugin_path.c_str());
+            }
+
+            plugin_paths = plugin_cache.m_plugin_paths;
+        }
+
+        // Plugins are already resident, this only registers their entities with the project.
+        for (const std::string& plugin_path : plugin_paths)
+            project.get_plugin_store().load_plugin(plugin_path.c_str());
+    }
+
+    bool is_object_used(
+        const asr::Assembly&            assembly,
+        const std::string&              object_name)
+    {
+        for (const auto& object_instance : assembly.object_instances())
+        {
+            if (object_name == object_instance.get_object_name())
+                return true;
+        }
+
+        return false;
+    }
+
+    // Create an empty assembly for a node, with an instance of it in the parent assembly.
+    asr::Assembly* create_node_assembly(
+        asr::Assembly&                  assembly,
+        const std::string&              node_name,
+        AssemblyInstanceMap&            assembly_inst_map)
+    {
+        const std::string assembly_name = make_unique_name(assembly.assemblies(), node_name + "_assembly");
+        assembly.assemblies().insert(asr::AssemblyFactory().create(assembly_name.c_str()));
+
+        const std::string assembly_instance_name =
+            make_unique_name(assembly.assembly_instances(), assembly_name + "_instance");
+        assembly.assembly_instances().insert(
+            asr::AssemblyInstanceFactory::create(
+                assembly_instance_name.c_str(),
+                asr::ParamArray(),
+                assembly_name.c_str()));
+        assembly_inst_map[node_name] = assembly.assembly_instances().get_by_name(assembly_instance_name.c_str());
+
+        return assembly.assemblies().get_by_name(assembly_name.c_str());
+    }
+
+    void collect_mesh_objects(
+        asr::Assembly&                  assembly,
+        std::vector<asr::MeshObject*>&  mesh_objects)
+    {
+        const std::string mesh_object_model = asr::MeshObjectFactory().get_model();
+
+        for (asr::Object& object : assembly.objects())
+        {
+            if (object.get_model() == mesh_object_model)
+                mesh_objects.push_back(static_cast<asr::MeshObject*>(&object));
+        }
+
+        for (asr::Assembly& child_assembly : assembly.assemblies())
+            collect_mesh_objects(child_assembly, mesh_objects);
+    }
 }
 
 void set_camera_film_params(
@@ -1775,6 +2263,43 @@ asf::auto_release_ptr<asr::Camera> build_camera(
     return camera;
 }
 
+asf::auto_release_ptr<asr::Frame> build_interactive_frame(
+    Bitmap*                 bitmap,
+    const RendererSettings& settings,
+    const size_t            resolution_divisor,
+    const Box2&             priority_region)
+{
+    RendParams rend_params;
+    rend_params.inMtlEdit = false;
+    rend_params.rendType = RENDTYPE_NORMAL;
+
+    FrameRendParams frame_rend_params;
+
+    asf::auto_release_ptr<asr::Frame> frame(
+        build_frame(rend_params, frame_rend_params, bitmap, settings, GetCOREInterface()->GetTime(), resolution_divisor));
+
+    if (!priority_region.IsEmpty())
+    {
+        // Grow the region by a tile so that its immediate surroundings refine along with it.
+        const int margin = settings.m_tile_size;
+        const int divisor = static_cast<int>(resolution_divisor);
+        const int x0 = std::max(static_cast<int>(priority_region.left) - margin, 0) / divisor;
+        const int y0 = std::max(static_cast<int>(priority_region.top) - margin, 0) / divisor;
+        const int x1 = std::min(static_cast<int>(priority_region.right) + margin, bitmap->Width() - 1) / divisor;
+        const int y1 = std::min(static_cast<int>(priority_region.bottom) + margin, bitmap->Height() - 1) / divisor;
+
+        if (x0 <= x1 && y0 <= y1)
+        {
+            frame->set_crop_window(
+                asf::AABB2u(
+                    asf::Vector2u(x0, y0),
+                    asf::Vector2u(x1, y1)));
+        }
+    }
+
+    return frame;
+}
+
 asf::auto_release_ptr<asr::Project> build_project(
     const MaxSceneEntities&                 entities,
     const std::vector<DefaultLight>&        default_lights,
@@ -1789,8 +2314,11 @@ asf::auto_release_ptr<asr::Project> build_project(
     ObjectMap&                              object_map,
     ObjectInstanceMap&                      object_inst_map,
     MaterialMap&                            material_map,
+    LightEmittingMtlMap&                    light_emitting_mtl_map,
     AssemblyMap&                            assembly_map,
-    AssemblyInstanceMap&                    assembly_inst_map)
+    AssemblyInstanceMap&                    assembly_inst_map,
+    LightMap&                               light_map,
+    const bool                              include_objects)
 {
     // Create an empty project.
     asf::auto_release_ptr<asr::Project> project(
@@ -1805,8 +2333,8 @@ asf::auto_release_ptr<asr::Project> build_project(
     project->search_paths().push_back_explicit_path("shaders/appleseed");
     project->search_paths().push_back_explicit_path(".");
 
-    // Discover and load plugins before building the scene.
-    project->get_plugin_store().load_all_plugins_from_paths(project->search_paths());
+    // Load plugins before building the scene.
+    load_plugins(project.ref());
 
     // Add default configurations to the project.
     project->add_default_configurations();
@@ -1844,8 +2372,11 @@ asf::auto_release_ptr<asr::Project> build_project(
         object_map,
         object_inst_map,
         material_map,
+        light_emitting_mtl_map,
         assembly_map,
-        assembly_inst_map);
+        assembly_inst_map,
+        light_map,
+        include_objects);
 
     // Create an instance of the assembly and insert it into the scene.
     asf::auto_release_ptr<asr::AssemblyInstance> assembly_instance(
@@ -1871,7 +2402,8 @@ asf::auto_release_ptr<asr::Project> build_project(
             rend_params,
             frame_rend_params,
             bitmap,
-            settings));
+            settings,
+            time));
 
     // Bind the scene to the project.
     project->set_scene(scene);
@@ -1892,6 +2424,7 @@ void add_object(
     ObjectMap&              object_map,
     ObjectInstanceMap&      object_inst_map,
     MaterialMap&            material_map,
+    LightEmittingMtlMap&    light_emitting_mtl_map,
     AssemblyMap&            assembly_map,
     AssemblyInstanceMap&    assembly_inst_map)
 {
@@ -1930,7 +2463,8 @@ void add_object(
                     settings,
                     time,
                     fake_instance_map,
-                    material_map);
+                    material_map,
+                    light_emitting_mtl_map);
             }
 
             // Remember the name of the assembly corresponding to that object.
@@ -1990,7 +2524,400 @@ void add_object(
                 settings,
                 time,
                 object_inst_map,
-                material_map);
+                material_map,
+                light_emitting_mtl_map);
+        }
+    }
+}
+
+void update_object_transform(
+    asr::Assembly&              assembly,
+    INode*                      node,
+    const TimeValue             time,
+    const ObjectMap&            object_map,
+    ObjectInstanceMap&          object_inst_map,
+    AssemblyInstanceMap&        assembly_inst_map)
+{
+    const std::string node_name = wide_to_utf8(node->GetName());
+
+    // Compute the new transform of this instance.
+    const asf::Transformd transform =
+        asf::Transformd::from_local_to_parent(
+            to_matrix4d(node->GetObjTMAfterWSM(time)));
+
+    const ObjectInstanceMap::iterator object_inst_it = object_inst_map.find(node_name);
+    if (object_inst_it != object_inst_map.end())
+    {
+        // Instances of helper objects always have an identity transform.
+        const ObjectMap::const_iterator object_it = object_map.find(node->GetObjectRef());
+        if (object_it != object_map.end())
+        {
+            for (const auto& object_info : object_it->second)
+            {
+                if (object_info.m_appleseed_geo_object != nullptr &&
+                    (object_info.m_appleseed_geo_object->get_flags() & IAppleseedGeometricObject::IgnoreTransform))
+                    return;
+            }
+        }
+
+        // Replace the instance by an identical one with the new transform, the object is left untouched.
+        const asr::ObjectInstance* object_instance = object_inst_it->second;
+        asf::auto_release_ptr<asr::ObjectInstance> new_object_instance(
+            asr::ObjectInstanceFactory::create(
+                object_instance->get_name(),
+                object_instance->get_parameters(),
+                object_instance->get_object_name(),
+                transform,
+                object_instance->get_front_material_mappings(),
+                object_instance->get_back_material_mappings()));
+
+        assembly.object_instances().remove(object_inst_it->second);
+        const size_t instance_index = assembly.object_instances().insert(new_object_instance);
+        object_inst_it->second = assembly.object_instances().get_by_index(instance_index);
+    }
+
+    const AssemblyInstanceMap::iterator assembly_inst_it = assembly_inst_map.find(node_name);
+    if (assembly_inst_it != assembly_inst_map.end())
+    {
+        asr::AssemblyInstance* assembly_instance = assembly_inst_it->second;
+
+        assembly_instance->transform_sequence().clear();
+        assembly_instance->transform_sequence().set_transform(0.0, transform);
+
+        // Apply transformation motion blur if enabled on that object.
+        if (is_motion_blur_enabled(node, time))
+        {
+            assembly_instance->transform_sequence()
+                .set_transform(1.0, asf::Transformd::from_local_to_parent(
+                    to_matrix4d(node->GetObjTMAfterWSM(time + GetTicksPerFrame()))));
+        }
+
+        assembly_instance->bump_version_id();
+    }
+}
+
+bool promote_object_instance(
+    asr::Assembly&              assembly,
+    INode*                      node,
+    const ObjectMap&            object_map,
+    ObjectInstanceMap&          object_inst_map,
+    AssemblyInstanceMap&        assembly_inst_map)
+{
+    const std::string node_name = wide_to_utf8(node->GetName());
+
+    const ObjectInstanceMap::iterator object_inst_it = object_inst_map.find(node_name);
+    if (object_inst_it == object_inst_map.end())
+        return false;
+
+    // Instances of helper objects always have an identity transform, they never move.
+    const ObjectMap::const_iterator object_it = object_map.find(node->GetObjectRef());
+    if (object_it != object_map.end())
+    {
+        for (const auto& object_info : object_it->second)
+        {
+            if (object_info.m_appleseed_geo_object != nullptr &&
+                (object_info.m_appleseed_geo_object->get_flags() & IAppleseedGeometricObject::IgnoreTransform))
+                return false;
+        }
+    }
+
+    asr::Assembly* object_assembly = create_node_assembly(assembly, node_name, assembly_inst_map);
+
+    // The transform of the node moves to the assembly instance, see update_object_transform().
+    const asr::ObjectInstance* object_instance = object_inst_it->second;
+    const std::string object_name = object_instance->get_object_name();
+    object_assembly->object_instances().insert(
+        asr::ObjectInstanceFactory::create(
+            object_instance->get_name(),
+            object_instance->get_parameters(),
+            object_name.c_str(),
+            asf::Transformd::identity(),
+            object_instance->get_front_material_mappings(),
+            object_instance->get_back_material_mappings()));
+    assembly.object_instances().remove(object_inst_it->second);
+    object_inst_map.erase(object_inst_it);
+
+    // Move the object along unless other instances use it, in which case it is found in the parent assembly.
+    asr::Object* object = assembly.objects().get_by_name(object_name.c_str());
+    if (object != nullptr && !is_object_used(assembly, object_name))
+        object_assembly->objects().insert(assembly.objects().remove(object));
+
+    return true;
+}
+
+void update_light(
+    asr::Assembly&              assembly,
+    INode*                      light_node,
+    const TimeValue             time,
+    LightMap&                   light_map)
+{
+    remove_light(assembly, light_node, light_map);
+
+    // Disabled lights are collected but not exported.
+    const ObjectState object_state = light_node->EvalWorldState(time);
+    if (object_state.obj == nullptr || object_state.obj->SuperClassID() != LIGHT_CLASS_ID)
+        return;
+    if (static_cast<LightObject*>(object_state.obj)->GetUseLight() == 0)
+        return;
+
+    // The environment map is needed to find out if this light drives the sun.
+    RendParams rend_params;
+    rend_params.envMap = GetCOREInterface()->GetUseEnvironmentMap() ? GetCOREInterface()->GetEnvironmentMap() : nullptr;
+
+    add_light(assembly, rend_params, light_node, time, light_map);
+}
+
+void remove_light(
+    asr::Assembly&              assembly,
+    INode*                      light_node,
+    LightMap&                   light_map)
+{
+    const LightMap::iterator it = light_map.find(wide_to_utf8(light_node->GetName()));
+    if (it == light_map.end())
+        return;
+
+    asr::Light* light = assembly.lights().get_by_name(it->second.m_light_name.c_str());
+    if (light != nullptr)
+        assembly.lights().remove(light);
+
+    asr::ColorEntity* color = assembly.colors().get_by_name(it->second.m_color_name.c_str());
+    if (color != nullptr)
+        assembly.colors().remove(color);
+
+    light_map.erase(it);
+}
+
+bool update_object_assembly(
+    asr::Project&               project,
+    asr::Assembly&              assembly,
+    INode*                      node,
+    const RendererSettings&     settings,
+    const TimeValue             time,
+    ObjectInstanceMap&          object_inst_map,
+    MaterialMap&                material_map,
+    LightEmittingMtlMap&        light_emitting_mtl_map,
+    AssemblyInstanceMap&        assembly_inst_map)
+{
+    const std::string node_name = wide_to_utf8(node->GetName());
+    bool parent_changed = false;
+
+    // Look for the assembly of this node, if it was already promoted.
+    asr::AssemblyInstance* assembly_instance = nullptr;
+    asr::Assembly* object_assembly = nullptr;
+    const AssemblyInstanceMap::iterator assembly_inst_it = assembly_inst_map.find(node_name);
+    if (assembly_inst_it != assembly_inst_map.end())
+    {
+        assembly_instance = assembly_inst_it->second;
+        object_assembly = assembly.assemblies().get_by_name(assembly_instance->get_assembly_name());
+
+        // Assemblies shared by several instances can't be modified in place.
+        size_t instance_count = 0;
+        for (const auto& other_instance : assembly.assembly_instances())
+        {
+            if (std::strcmp(other_instance.get_assembly_name(), assembly_instance->get_assembly_name()) == 0)
+                ++instance_count;
+        }
+
+        if (instance_count > 1)
+        {
+            assembly.assembly_instances().remove(assembly_instance);
+            assembly_inst_map.erase(assembly_inst_it);
+            assembly_instance = nullptr;
+            object_assembly = nullptr;
+            parent_changed = true;
+        }
+    }
+
+    if (object_assembly == nullptr)
+    {
+        // Move the node out of the parent assembly, along with its object unless other instances use it.
+        const ObjectInstanceMap::iterator object_inst_it = object_inst_map.find(node_name);
+        if (object_inst_it != object_inst_map.end())
+        {
+            const std::string object_name = object_inst_it->second->get_object_name();
+            assembly.object_instances().remove(object_inst_it->second);
+            object_inst_map.erase(object_inst_it);
+
+            asr::Object* object = assembly.objects().get_by_name(object_name.c_str());
+            if (object != nullptr && !is_object_used(assembly, object_name))
+                assembly.objects().remove(object);
+        }
+
+        // Create an assembly for this node.
+        object_assembly = create_node_assembly(assembly, node_name, assembly_inst_map);
+        assembly_instance = assembly_inst_map[node_name];
+
+        parent_changed = true;
+    }
+    else
+    {
+        // Clear the previous contents of the assembly.
+        while (object_assembly->object_instances().size() > 0)
+            object_assembly->object_instances().remove(object_assembly->object_instances().get_by_index(0));
+        while (object_assembly->objects().size() > 0)
+            object_assembly->objects().remove(object_assembly->objects().get_by_index(0));
+    }
+
+    // Add objects and object instances to the assembly.
+    ObjectInstanceMap fake_instance_map;
+    bool ignore_transform = false;
+    auto object_infos = create_objects(project, *object_assembly, node, time);
+    for (auto& object_info : object_infos)
+    {
+        if (object_info.m_appleseed_geo_object != nullptr &&
+            (object_info.m_appleseed_geo_object->get_flags() & IAppleseedGeometricObject::IgnoreTransform))
+            ignore_transform = true;
+
+        create_object_instance(
+            *object_assembly,
+            &assembly,
+            node,
+            asf::Transformd::identity(),
+            object_info,
+            RenderType::Default,
+            settings,
+            time,
+            fake_instance_map,
+            material_map,
+            light_emitting_mtl_map);
+    }
+
+    object_assembly->bump_version_id();
+
+    // Place the assembly instance where the node is. Instances of helper objects always have an identity transform.
+    assembly_instance->transform_sequence().clear();
+    assembly_instance->transform_sequence().set_transform(
+        0.0,
+        ignore_transform
+            ? asf::Transformd::identity()
+            : asf::Transformd::from_local_to_parent(to_matrix4d(node->GetObjTMAfterWSM(time))));
+
+    // Apply transformation motion blur if enabled on that object.
+    if (!ignore_transform && is_motion_blur_enabled(node, time))
+    {
+        assembly_instance->transform_sequence()
+            .set_transform(1.0, asf::Transformd::from_local_to_parent(
+                to_matrix4d(node->GetObjTMAfterWSM(time + GetTicksPerFrame()))));
+    }
+
+    assembly_instance->bump_version_id();
+
+    return parent_changed;
+}
+
+bool write_project_file(
+    asr::Project&                       project,
+    const std::string&                  filepath,
+    std::vector<GeometryFile>&          geometry_files)
+{
+    std::vector<asr::MeshObject*> mesh_objects;
+    for (asr::Assembly& assembly : project.get_scene()->assemblies())
+        collect_mesh_objects(assembly, mesh_objects);
+
+    // The project file may be loaded from another directory than the one of the plugin, make search paths absolute
+    // for the time it takes to write it.
+    const asf::SearchPaths search_paths = project.search_paths();
+    asf::SearchPaths absolute_search_paths;
+    for (const std::string& dir : get_absolute_search_paths(search_paths))
+        absolute_search_paths.push_back_explicit_path(dir.c_str());
+    project.search_paths() = absolute_search_paths;
+
+    // Point mesh objects to geometry files next to the project file, for the time it takes to write it.
+    const bf::path project_path(filepath);
+    std::vector<std::pair<bool, std::string>> previous_filenames;
+    geometry_files.clear();
+    for (size_t i = 0, e = mesh_objects.size(); i < e; ++i)
+    {
+        asf::StringDictionary& params = mesh_objects[i]->get_parameters().strings();
+
+        const bool had_filename = params.exist("filename");
+        previous_filenames.emplace_back(had_filename, had_filename ? params.get("filename") : "");
+
+        const std::string filename = project_path.stem().string() + "." + std::to_string(i) + ".binarymesh";
+        params.insert("filename", filename);
+
+        GeometryFile geometry_file;
+        geometry_file.m_object = mesh_objects[i];
+        geometry_file.m_filepath = (project_path.parent_path() / filename).string();
+        geometry_files.push_back(geometry_file);
+    }
+
+    const bool success =
+        asr::ProjectFileWriter::write(
+            project,
+            filepath.c_str(),
+            asr::ProjectFileWriter::OmitWritingGeometryFiles | asr::ProjectFileWriter::OmitHandlingAssetFiles);
+
+    for (size_t i = 0, e = mesh_objects.size(); i < e; ++i)
+    {
+        asf::StringDictionary& params = mesh_objects[i]->get_parameters().strings();
+
+        if (previous_filenames[i].first)
+            params.insert("filename", previous_filenames[i].second);
+        else
+            params.remove("filename");
+    }
+
+    project.search_paths() = search_paths;
+
+    if (!success)
+        RENDERER_LOG_ERROR("failed to write project file %s.", filepath.c_str());
+
+    return success;
+}
+
+bool write_geometry_files(const std::vector<GeometryFile>& geometry_files)
+{
+    bool success = true;
+
+    for (const GeometryFile& geometry_file : geometry_files)
+    {
+        if (!asr::MeshObjectWriter::write(
+                *geometry_file.m_object,
+                geometry_file.m_object->get_name(),
+                geometry_file.m_filepath.c_str()))
+        {
+            RENDERER_LOG_ERROR("failed to write geometry file %s.", geometry_file.m_filepath.c_str());
+            success = false;
         }
     }
+
+    return success;
+}
+
+void delete_checkpoint(
+    const RendererSettings&             settings,
+    const TimeValue                     time)
+{
+    if (!(settings.m_enable_checkpoint || settings.m_resume_from_checkpoint) || settings.m_passes < 2)
+        return;
+
+    const std::string checkpoint_path = get_checkpoint_path(settings, time);
+    if (checkpoint_path.empty())
+        return;
+
+    boost::system::error_code ec;
+    if (bf::remove(checkpoint_path, ec))
+        RENDERER_LOG_INFO("deleted checkpoint %s.", checkpoint_path.c_str());
+}
+
+std::vector<std::string> get_absolute_search_paths(const asf::SearchPaths& search_paths)
+{
+    std::vector<std::string> dirs;
+    asf::split(search_paths.to_string(';').c_str(), ";", dirs);
+
+    std::vector<std::string> absolute_dirs;
+    for (const std::string& dir : dirs)
+    {
+        if (dir.empty())
+            continue;
+
+        bf::path dir_path(dir);
+        if (dir_path.is_relative())
+            dir_path = bf::path(get_root_path()) / dir_path;
+
+        absolute_dirs.push_back(dir_path.string());
+    }
+
+    return absolute_dirs;
 }
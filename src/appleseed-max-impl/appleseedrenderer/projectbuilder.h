@@ -39,18 +39,23 @@
 
 // 3ds Max headers.
 #include "appleseed-max-common/_beginmaxheaders.h"
+#include <box2.h>
 #include <maxtypes.h>
 #include <render.h>
 #include "appleseed-max-common/_endmaxheaders.h"
 
 // Standard headers.
 #include <map>
+#include <string>
 #include <vector>
 
 // Forward declarations.
+namespace foundation { class SearchPaths; }
 namespace renderer { class Assembly; }
 namespace renderer { class AssemblyInstance; }
 namespace renderer { class Camera; }
+namespace renderer { class Frame; }
+namespace renderer { class MeshObject; }
 namespace renderer { class ObjectInstance; }
 namespace renderer { class Project; }
 class Bitmap;
@@ -80,9 +85,19 @@ typedef std::map<std::string, renderer::ObjectInstance*> ObjectInstanceMap;
 typedef std::map<std::string, renderer::AssemblyInstance*> AssemblyInstanceMap;
 typedef std::map<Mtl*, std::string> MaterialMap;
 typedef std::map<IAppleseedMtl*, std::string> IAppleseedMtlMap;
+typedef std::map<Mtl*, bool> LightEmittingMtlMap;
 typedef std::map<Object*, std::string> AssemblyMap;
 
+struct LightInfo
+{
+    std::string                         m_light_name;                   // name of the appleseed light
+    std::string                         m_color_name;                   // name of the color entity of the light
+};
+
+typedef std::map<std::string, LightInfo> LightMap;
+
 // Build an appleseed project from the current 3ds Max scene.
+// If `include_objects` is false, materials are translated but objects are left out of the project.
 foundation::auto_release_ptr<renderer::Project> build_project(
     const MaxSceneEntities&             entities,
     const std::vector<DefaultLight>&    default_lights,
@@ -97,8 +112,11 @@ foundation::auto_release_ptr<renderer::Project> build_project(
     ObjectMap&                          object_map,
     ObjectInstanceMap&                  object_inst_map,
     MaterialMap&                        material_map,
+    LightEmittingMtlMap&                light_emitting_mtl_map,
     AssemblyMap&                        assembly_map,
-    AssemblyInstanceMap&                assembly_inst_map);
+    AssemblyInstanceMap&                assembly_inst_map,
+    LightMap&                           light_map,
+    const bool                          include_objects = true);
 
 foundation::auto_release_ptr<renderer::Camera> build_camera(
     INode*                              view_node,
@@ -107,6 +125,14 @@ foundation::auto_release_ptr<renderer::Camera> build_camera(
     const RendererSettings&             settings,
     const TimeValue                     time);
 
+// Build the frame of an ActiveShade session, at a fraction of the bitmap resolution.
+// If `priority_region` isn't empty, rendering is restricted to it and its surroundings.
+foundation::auto_release_ptr<renderer::Frame> build_interactive_frame(
+    Bitmap*                             bitmap,
+    const RendererSettings&             settings,
+    const size_t                        resolution_divisor,
+    const Box2&                         priority_region);
+
 void add_object(
     renderer::Project&                  project,
     renderer::Assembly&                 assembly,
@@ -117,5 +143,78 @@ void add_object(
     ObjectMap&                          object_map,
     ObjectInstanceMap&                  instance_map,
     MaterialMap&                        material_map,
+    LightEmittingMtlMap&                light_emitting_mtl_map,
     AssemblyMap&                        assembly_map,
     AssemblyInstanceMap&                assembly_inst_map);
+
+// Update the transform of the instances of a node without rebuilding its objects or materials.
+void update_object_transform(
+    renderer::Assembly&                 assembly,
+    INode*                              node,
+    const TimeValue                     time,
+    const ObjectMap&                    object_map,
+    ObjectInstanceMap&                  object_inst_map,
+    AssemblyInstanceMap&                assembly_inst_map);
+
+// Move the instance of a node, and its object unless other instances use it, into an assembly of its own
+// without converting the object again, so that later transform edits only move the instance of that assembly.
+// Return false, leaving the parent assembly untouched, if the node has no object instance or never moves.
+bool promote_object_instance(
+    renderer::Assembly&                 assembly,
+    INode*                              node,
+    const ObjectMap&                    object_map,
+    ObjectInstanceMap&                  object_inst_map,
+    AssemblyInstanceMap&                assembly_inst_map);
+
+// Rebuild the appleseed light corresponding to a 3ds Max light node, or create it if it doesn't exist yet.
+void update_light(
+    renderer::Assembly&                 assembly,
+    INode*                              light_node,
+    const TimeValue                     time,
+    LightMap&                           light_map);
+
+// Remove the appleseed light corresponding to a 3ds Max light node, if any.
+void remove_light(
+    renderer::Assembly&                 assembly,
+    INode*                              light_node,
+    LightMap&                           light_map);
+
+// Rebuild the objects of a node inside an assembly of its own, so that later edits of that node only
+// invalidate the acceleration structures of this small assembly. The node and its objects are moved out
+// of the parent assembly on its first geometry edit, unless promote_object_instance() already did.
+// Return true if the contents of the parent assembly changed.
+bool update_object_assembly(
+    renderer::Project&                  project,
+    renderer::Assembly&                 assembly,
+    INode*                              node,
+    const RendererSettings&             settings,
+    const TimeValue                     time,
+    ObjectInstanceMap&                  object_inst_map,
+    MaterialMap&                        material_map,
+    LightEmittingMtlMap&                light_emitting_mtl_map,
+    AssemblyInstanceMap&                assembly_inst_map);
+
+// Delete the checkpoint file of a frame of final renders, if checkpoints are enabled and the file exists.
+void delete_checkpoint(
+    const RendererSettings&             settings,
+    const TimeValue                     time);
+
+struct GeometryFile
+{
+    const renderer::MeshObject*         m_object = {};                  // mesh object stored in the geometry file
+    std::string                         m_filepath;                     // path to the geometry file
+};
+
+// Write a project file in which mesh objects reference geometry files next to the project file, and with
+// absolute search paths. Neither the project nor its asset paths are modified, and geometry files are not written:
+// they are returned in `geometry_files` and must be written with write_geometry_files().
+bool write_project_file(
+    renderer::Project&                  project,
+    const std::string&                  filepath,
+    std::vector<GeometryFile>&          geometry_files);
+
+// Write geometry files. The project is only read, so this may happen while it is being rendered.
+bool write_geometry_files(const std::vector<GeometryFile>& geometry_files);
+
+// Return search paths, relative ones being resolved against the root path of the plugin.
+std::vector<std::string> get_absolute_search_paths(const foundation::SearchPaths& search_paths);
@@ -32,14 +32,33 @@
 // Build options header.
 #include "foundation/core/buildoptions.h"
 
+// appleseed.renderer headers.
+#include "renderer/api/frame.h"
+#include "renderer/api/log.h"
+#include "renderer/api/scene.h"
+
 // appleseed.foundation headers.
+#include "foundation/image/canvasproperties.h"
+#include "foundation/image/color.h"
+#include "foundation/image/colorspace.h"
+#include "foundation/image/image.h"
+#include "foundation/image/tile.h"
+#include "foundation/math/aabb.h"
+#include "foundation/math/transform.h"
 #include "foundation/platform/atomic.h"
+#include "foundation/string/string.h"
 
 // 3ds Max headers.
 #include "appleseed-max-common/_beginmaxheaders.h"
 #include <render.h>
 #include "appleseed-max-common/_endmaxheaders.h"
 
+// Standard headers.
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+
 namespace asf = foundation;
 namespace asr = renderer;
 
@@ -51,12 +70,210 @@ RendererController::RendererController(
   , m_rendered_tile_count(rendered_tile_count)
   , m_total_tile_count(total_tile_count)
   , m_status(ContinueRendering)
+  , m_budget_enabled(false)
+  , m_pass_count(0)
+  , m_tiles_per_pass(0)
+  , m_time_limit(0.0)
+  , m_noise_target(0.0f)
+  , m_completed_pass_count(0)
+  , m_noise_level(-1.0f)
+  , m_budget_met(false)
+{
+}
+
+void RendererController::set_frame_begin_callback(std::function<void ()> callback)
 {
+    m_frame_begin_callback = std::move(callback);
+}
+
+void RendererController::set_render_budget(
+    const asr::Frame&       frame,
+    const size_t            pass_count,
+    const double            time_limit,
+    const float             noise_target)
+{
+    if (time_limit <= 0.0 && noise_target <= 0.0f)
+        return;
+
+    // The render can only stop between passes.
+    if (pass_count < 2)
+    {
+        RENDERER_LOG_WARNING("the render time limit and noise target require more than one render pass, ignoring them.");
+        return;
+    }
+
+    m_budget_enabled = true;
+    m_pass_count = pass_count;
+    m_time_limit = time_limit;
+    m_noise_target = noise_target;
+
+    // Only the tiles overlapping the crop window are rendered.
+    const asf::CanvasProperties& props = frame.image().properties();
+    const asf::AABB2u& crop_window = frame.get_crop_window();
+    m_tiles_per_pass = 0;
+    for (size_t tile_y = 0; tile_y < props.m_tile_count_y; ++tile_y)
+    {
+        for (size_t tile_x = 0; tile_x < props.m_tile_count_x; ++tile_x)
+        {
+            const size_t x0 = tile_x * props.m_tile_width;
+            const size_t y0 = tile_y * props.m_tile_height;
+            const size_t x1 = std::min(x0 + props.m_tile_width, props.m_canvas_width) - 1;
+            const size_t y1 = std::min(y0 + props.m_tile_height, props.m_canvas_height) - 1;
+            if (x0 <= crop_window.max.x && x1 >= crop_window.min.x &&
+                y0 <= crop_window.max.y && y1 >= crop_window.min.y)
+                ++m_tiles_per_pass;
+        }
+    }
+
+    m_tile_luminances.resize(props.m_tile_count);
+    m_tile_pass_counts.resize(props.m_tile_count);
+    m_pass_stats.resize(pass_count);
+}
+
+void RendererController::on_tile_end(
+    const asr::Frame&       frame,
+    const size_t            tile_x,
+    const size_t            tile_y)
+{
+    if (!m_budget_enabled)
+        return;
+
+    const asf::CanvasProperties& props = frame.image().properties();
+    const asf::AABB2u& crop_window = frame.get_crop_window();
+    const asf::Tile& tile = frame.image().tile(tile_x, tile_y);
+    const size_t tile_width = tile.get_width();
+    const size_t tile_height = tile.get_height();
+    const size_t origin_x = tile_x * props.m_tile_width;
+    const size_t origin_y = tile_y * props.m_tile_height;
+
+    // A given tile is only ever rendered by one thread at a time.
+    const size_t tile_index = tile_y * props.m_tile_count_x + tile_x;
+    const size_t pass = m_tile_pass_counts[tile_index]++;
+    if (pass >= m_pass_count)
+        return;
+
+    std::vector<float>& luminances = m_tile_luminances[tile_index];
+    const bool has_previous_pass = !luminances.empty();
+    luminances.resize(tile_width * tile_height);
+
+    // The frame holds the mean of all passes so far. The difference between two consecutive means is the
+    // deviation of the last pass from the mean divided by the number of passes, which estimates the noise.
+    double squared_error = 0.0;
+    size_t pixel_count = 0;
+    for (size_t y = 0; y < tile_height; ++y)
+    {
+        for (size_t x = 0; x < tile_width; ++x)
+        {
+            if (origin_x + x < crop_window.min.x || origin_x + x > crop_window.max.x ||
+                origin_y + y < crop_window.min.y || origin_y + y > crop_window.max.y)
+                continue;
+
+            asf::Color4f color;
+            tile.get_pixel(x, y, color);
+            const float luminance = std::max(asf::luminance(color.rgb()), 0.0f);
+
+            float& previous_luminance = luminances[y * tile_width + x];
+            if (has_previous_pass)
+            {
+                // The offset keeps nearly black pixels from dominating the relative error.
+                const double error = (luminance - previous_luminance) / (luminance + 0.05);
+                squared_error += error * error;
+                ++pixel_count;
+            }
+            previous_luminance = luminance;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_pass_stats_mutex);
+
+    PassStats& stats = m_pass_stats[pass];
+    stats.m_squared_error += squared_error;
+    stats.m_pixel_count += pixel_count;
+
+    if (++stats.m_tile_count < m_tiles_per_pass)
+        return;
+
+    // All tiles of this pass are rendered.
+    m_completed_pass_count = pass + 1;
+    if (stats.m_pixel_count > 0)
+    {
+        m_noise_level =
+            static_cast<float>(
+                std::sqrt(stats.m_squared_error / stats.m_pixel_count * m_completed_pass_count));
+    }
+
+    if (m_completed_pass_count == m_pass_count)
+        return;
+
+    const double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - m_rendering_begin_time).count();
+
+    if (m_time_limit > 0.0 && elapsed >= m_time_limit)
+    {
+        RENDERER_LOG_INFO(
+            "render time limit reached after %s pass%s, stopping rendering.",
+            asf::pretty_uint(m_completed_pass_count).c_str(),
+            m_completed_pass_count > 1 ? "es" : "");
+        m_budget_met = true;
+    }
+    else if (m_noise_target > 0.0f && m_noise_level >= 0.0f && m_noise_level <= m_noise_target)
+    {
+        RENDERER_LOG_INFO(
+            "noise target reached after %s passes, stopping rendering.",
+            asf::pretty_uint(m_completed_pass_count).c_str());
+        m_budget_met = true;
+    }
 }
 
 void RendererController::on_rendering_begin()
 {
     m_status = ContinueRendering;
+
+    m_rendering_begin_time = std::chrono::steady_clock::now();
+    m_budget_met = false;
+
+    std::lock_guard<std::mutex> lock(m_pass_stats_mutex);
+    for (std::vector<float>& luminances : m_tile_luminances)
+        luminances.clear();
+    std::fill(m_tile_pass_counts.begin(), m_tile_pass_counts.end(), 0);
+    std::fill(m_pass_stats.begin(), m_pass_stats.end(), PassStats());
+    m_completed_pass_count = 0;
+    m_noise_level = -1.0f;
+}
+
+void RendererController::on_frame_begin()
+{
+    if (m_frame_begin_callback)
+        m_frame_begin_callback();
+}
+
+void RendererController::on_frame_end()
+{
+    if (!m_budget_enabled)
+        return;
+
+    const double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - m_rendering_begin_time).count();
+
+    std::lock_guard<std::mutex> lock(m_pass_stats_mutex);
+
+    if (m_noise_level >= 0.0f)
+    {
+        RENDERER_LOG_INFO(
+            "rendered %s of %s passes in %s, estimated noise level: %.4f.",
+            asf::pretty_uint(m_completed_pass_count).c_str(),
+            asf::pretty_uint(m_pass_count).c_str(),
+            asf::pretty_time(elapsed).c_str(),
+            m_noise_level);
+    }
+    else
+    {
+        RENDERER_LOG_INFO(
+            "rendered %s of %s passes in %s, noise level unknown.",
+            asf::pretty_uint(m_completed_pass_count).c_str(),
+            asf::pretty_uint(m_pass_count).c_str(),
+            asf::pretty_time(elapsed).c_str());
+    }
 }
 
 void RendererController::on_progress()
@@ -72,6 +289,110 @@ void RendererController::on_progress()
 }
 
 asr::IRendererController::Status RendererController::get_status() const
+{
+    // Never blocks render threads: the renderer polls this status and stops soon after the pass boundary.
+    // Terminating keeps the frame rendered so far, unlike aborting.
+    if (m_status == ContinueRendering && m_budget_met)
+        return TerminateRendering;
+
+    return m_status;
+}
+
+
+//
+// PipelinedRendererController class implementation.
+//
+
+PipelinedRendererController::PipelinedRendererController(
+    asr::Assembly&          parent_assembly,
+    volatile std::uint32_t* rendered_tile_count)
+  : m_parent_assembly(parent_assembly)
+  , m_rendered_tile_count(rendered_tile_count)
+  , m_assemblies_ended(false)
+  , m_status(ContinueRendering)
+{
+}
+
+PipelinedRendererController::~PipelinedRendererController()
+{
+    for (asr::Assembly* assembly : m_pending_assemblies)
+        assembly->release();
+}
+
+void PipelinedRendererController::add_assembly(asf::auto_release_ptr<asr::Assembly> assembly)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_pending_assemblies.push_back(assembly.release());
+
+    if (m_status != AbortRendering)
+        m_status = ReinitializeRendering;
+
+    m_assemblies_changed.notify_all();
+}
+
+void PipelinedRendererController::end_assemblies()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_assemblies_ended = true;
+    m_assemblies_changed.notify_all();
+}
+
+bool PipelinedRendererController::wait_for_assemblies()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_assemblies_changed.wait(
+        lock,
+        [this]()
+        {
+            return !m_pending_assemblies.empty() || m_assemblies_ended || m_status == AbortRendering;
+        });
+
+    return !m_pending_assemblies.empty() && m_status != AbortRendering;
+}
+
+void PipelinedRendererController::abort_rendering()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_status = AbortRendering;
+    m_assemblies_changed.notify_all();
+}
+
+void PipelinedRendererController::on_rendering_begin()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_pending_assemblies.empty())
+    {
+        for (asr::Assembly* assembly : m_pending_assemblies)
+        {
+            const std::string assembly_name = assembly->get_name();
+            m_parent_assembly.assemblies().insert(asf::auto_release_ptr<asr::Assembly>(assembly));
+
+            asf::auto_release_ptr<asr::AssemblyInstance> assembly_instance(
+                asr::AssemblyInstanceFactory::create(
+                    (assembly_name + "_inst").c_str(),
+                    asr::ParamArray(),
+                    assembly_name.c_str()));
+            assembly_instance->transform_sequence().set_transform(0.0, asf::Transformd::identity());
+            m_parent_assembly.assembly_instances().insert(assembly_instance);
+        }
+
+        m_pending_assemblies.clear();
+        m_parent_assembly.bump_version_id();
+    }
+
+    // Progress restarts along with rendering.
+    asf::atomic_write(m_rendered_tile_count, 0);
+
+    if (m_status != AbortRendering)
+        m_status = ContinueRendering;
+}
+
+asr::IRendererController::Status PipelinedRendererController::get_status() const
 {
     return m_status;
 }
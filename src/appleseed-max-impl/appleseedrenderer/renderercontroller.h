@@ -34,11 +34,22 @@
 // appleseed.renderer headers.
 #include "renderer/api/rendering.h"
 
+// appleseed.foundation headers.
+#include "foundation/memory/autoreleaseptr.h"
+
 // Standard headers.
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 // Forward declarations.
+namespace renderer  { class Assembly; }
+namespace renderer  { class Frame; }
 class RendProgressCallback;
 
 class RendererController
@@ -50,15 +61,99 @@ class RendererController
         volatile std::uint32_t*         rendered_tile_count,
         const size_t                    total_tile_count);
 
+    // Set a function called once the scene is prepared and rendering of the frame starts.
+    void set_frame_begin_callback(std::function<void ()> callback);
+
+    // Stop rendering at the first pass boundary after the time limit (in seconds) is reached or
+    // after the estimated noise level drops below the target. Zero disables either criterion.
+    void set_render_budget(
+        const renderer::Frame&          frame,
+        const size_t                    pass_count,
+        const double                    time_limit,
+        const float                     noise_target);
+
+    // Thread-safe. Must be called by the tile callback once a tile is rendered.
+    void on_tile_end(
+        const renderer::Frame&          frame,
+        const size_t                    tile_x,
+        const size_t                    tile_y);
+
     void on_rendering_begin() override;
 
+    void on_frame_begin() override;
+
+    void on_frame_end() override;
+
     void on_progress() override;
 
     Status get_status() const override;
 
   private:
+    struct PassStats
+    {
+        double                          m_squared_error = 0.0;
+        size_t                          m_pixel_count = 0;
+        size_t                          m_tile_count = 0;
+    };
+
     RendProgressCallback*               m_progress_cb;
+    std::function<void ()>              m_frame_begin_callback;
     volatile std::uint32_t*             m_rendered_tile_count;
     const size_t                        m_total_tile_count;
     Status                              m_status;
+
+    // Render budget.
+    bool                                m_budget_enabled;
+    size_t                              m_pass_count;
+    size_t                              m_tiles_per_pass;
+    double                              m_time_limit;
+    float                               m_noise_target;
+    std::chrono::steady_clock::time_point m_rendering_begin_time;
+    std::vector<std::vector<float>>     m_tile_luminances;      // per tile, luminance after its last pass
+    std::vector<size_t>                 m_tile_pass_counts;
+    std::mutex                          m_pass_stats_mutex;
+    std::vector<PassStats>              m_pass_stats;
+    size_t                              m_completed_pass_count;
+    float                               m_noise_level;          // -1 until two passes are completed
+    std::atomic<bool>                   m_budget_met;           // set at the pass boundary where the budget was met
+};
+
+// Renderer controller for renders that start while objects are still being translated.
+// Assemblies of translated objects are handed over from the translating thread and inserted
+// into the scene between two renderings, when the renderer doesn't access the scene.
+class PipelinedRendererController
+  : public renderer::DefaultRendererController
+{
+  public:
+    PipelinedRendererController(
+        renderer::Assembly&             parent_assembly,
+        volatile std::uint32_t*         rendered_tile_count);
+
+    ~PipelinedRendererController() override;
+
+    // Thread-safe. Insert an assembly and an instance of it into the parent assembly and restart rendering.
+    void add_assembly(foundation::auto_release_ptr<renderer::Assembly> assembly);
+
+    // Thread-safe. Signal that no more assemblies will be added.
+    void end_assemblies();
+
+    // Thread-safe. Once a render completed, wait until more assemblies are added or until no more will be.
+    // Return true if assemblies are pending, in which case the frame must be rendered again.
+    bool wait_for_assemblies();
+
+    // Thread-safe.
+    void abort_rendering();
+
+    void on_rendering_begin() override;
+
+    Status get_status() const override;
+
+  private:
+    renderer::Assembly&                 m_parent_assembly;
+    volatile std::uint32_t*             m_rendered_tile_count;
+    std::mutex                          m_mutex;
+    std::condition_variable             m_assemblies_changed;
+    std::vector<renderer::Assembly*>    m_pending_assemblies;
+    bool                                m_assemblies_ended;
+    std::atomic<Status>                 m_status;
 };
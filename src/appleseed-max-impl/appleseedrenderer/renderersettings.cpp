@@ -60,6 +60,10 @@ namespace
             m_sampler_type = 0;
             m_noise_seed = 0;
             m_enable_noise_seed = true;
+            m_enable_checkpoint = false;
+            m_resume_from_checkpoint = false;
+            m_render_time_limit = 0;
+            m_render_noise_target = 0.0f;
 
             m_uniform_pixel_samples = 64;
 
@@ -433,6 +437,22 @@ bool RendererSettings::save(ISave* isave) const
         success &= write<bool>(isave, m_enable_noise_seed);
         isave->EndChunk();
 
+        isave->BeginChunk(ChunkSettingsEnableCheckpoint);
+        success &= write<bool>(isave, m_enable_checkpoint);
+        isave->EndChunk();
+
+        isave->BeginChunk(ChunkSettingsResumeFromCheckpoint);
+        success &= write<bool>(isave, m_resume_from_checkpoint);
+        isave->EndChunk();
+
+        isave->BeginChunk(ChunkSettingsRenderTimeLimit);
+        success &= write<int>(isave, m_render_time_limit);
+        isave->EndChunk();
+
+        isave->BeginChunk(ChunkSettingsRenderNoiseTarget);
+        success &= write<float>(isave, m_render_noise_target);
+        isave->EndChunk();
+
     isave->EndChunk();
 
     //
@@ -884,6 +904,22 @@ IOResult RendererSettings::load_image_sampling_settings(ILoad* iload)
           case ChunkSettingsEnableNoiseSeed:
             result = read<bool>(iload, &m_enable_noise_seed);
             break;
+
+          case ChunkSettingsEnableCheckpoint:
+            result = read<bool>(iload, &m_enable_checkpoint);
+            break;
+
+          case ChunkSettingsResumeFromCheckpoint:
+            result = read<bool>(iload, &m_resume_from_checkpoint);
+            break;
+
+          case ChunkSettingsRenderTimeLimit:
+            result = read<int>(iload, &m_render_time_limit);
+            break;
+
+          case ChunkSettingsRenderNoiseTarget:
+            result = read<float>(iload, &m_render_noise_target);
+            break;
         }
 
         if (result != IO_OK)
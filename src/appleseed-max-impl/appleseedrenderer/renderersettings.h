@@ -60,6 +60,10 @@ class RendererSettings
     int                         m_sampler_type;
     int                         m_noise_seed;
     bool                        m_enable_noise_seed;
+    bool                        m_enable_checkpoint;            // write a checkpoint after each pass
+    bool                        m_resume_from_checkpoint;       // continue from the last checkpoint, if any
+    int                         m_render_time_limit;            // in seconds, 0 for no limit
+    float                       m_render_noise_target;          // 0 for no target
 
     //
     // Uniform Pixel Sampler.
@@ -43,6 +43,12 @@
 #define IDC_TEXT_NOISE_SEED                             233
 #define IDC_SPINNER_NOISE_SEED                          234
 #define IDC_CHECK_ENABLE_NOISE_SEED                     235
+#define IDC_CHECK_ENABLE_CHECKPOINT                     236
+#define IDC_CHECK_RESUME_FROM_CHECKPOINT                237
+#define IDC_TEXT_RENDER_TIME_LIMIT                      238
+#define IDC_SPINNER_RENDER_TIME_LIMIT                   239
+#define IDC_TEXT_RENDER_NOISE_TARGET                    240
+#define IDC_SPINNER_RENDER_NOISE_TARGET                 241
 #define IDD_FORMVIEW_RENDERERPARAMS_PATH_TRACING        300
 #define IDC_CHECK_GI                                    301
 #define IDC_CHECK_CAUSTICS                              302
@@ -29,6 +29,9 @@
 // Interface header.
 #include "tilecallback.h"
 
+// appleseed-max headers.
+#include "appleseedrenderer/renderercontroller.h"
+
 // Build options header.
 #include "foundation/core/buildoptions.h"
 
@@ -48,6 +51,11 @@
 #include <bitmap.h>
 #include "appleseed-max-common/_endmaxheaders.h"
 
+// Standard headers.
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
 
 namespace asf = foundation;
 namespace asr = renderer;
@@ -125,16 +133,89 @@ namespace
         rect.bottom = static_cast<LONG>(y + height);
         return rect;
     }
+
+    // Merge dirty tiles into as few rectangles as possible: horizontal runs of dirty tiles
+    // are extended downward as long as the rows below have the exact same runs.
+    std::vector<RECT> merge_dirty_tiles(
+        const asf::CanvasProperties&    props,
+        const std::vector<bool>&        dirty_tiles)
+    {
+        std::vector<RECT> rects;
+        std::vector<size_t> open_rects;     // indices in `rects` of the rectangles ending on the previous row
+
+        for (size_t y = 0; y < props.m_tile_count_y; ++y)
+        {
+            std::vector<size_t> row_rects;
+
+            for (size_t x = 0; x < props.m_tile_count_x; )
+            {
+                if (!dirty_tiles[y * props.m_tile_count_x + x])
+                {
+                    ++x;
+                    continue;
+                }
+
+                size_t end_x = x + 1;
+                while (end_x < props.m_tile_count_x && dirty_tiles[y * props.m_tile_count_x + end_x])
+                    ++end_x;
+
+                const LONG left = static_cast<LONG>(x * props.m_tile_width);
+                const LONG right = static_cast<LONG>(std::min(end_x * props.m_tile_width, props.m_canvas_width));
+                const LONG bottom = static_cast<LONG>(std::min((y + 1) * props.m_tile_height, props.m_canvas_height));
+
+                const auto open_rect =
+                    std::find_if(
+                        open_rects.begin(),
+                        open_rects.end(),
+                        [&rects, left, right](const size_t i) { return rects[i].left == left && rects[i].right == right; });
+
+                if (open_rect != open_rects.end())
+                {
+                    rects[*open_rect].bottom = bottom;
+                    row_rects.push_back(*open_rect);
+                }
+                else
+                {
+                    RECT rect;
+                    rect.left = left;
+                    rect.top = static_cast<LONG>(y * props.m_tile_height);
+                    rect.right = right;
+                    rect.bottom = bottom;
+                    row_rects.push_back(rects.size());
+                    rects.push_back(rect);
+                }
+
+                x = end_x;
+            }
+
+            open_rects.swap(row_rects);
+        }
+
+        return rects;
+    }
 }
 
 TileCallback::TileCallback(
     Bitmap*                 bitmap,
-    volatile std::uint32_t* rendered_tile_count)
+    volatile std::uint32_t* rendered_tile_count,
+    RendererController*     renderer_controller)
   : m_bitmap(bitmap)
   , m_rendered_tile_count(rendered_tile_count)
+  , m_renderer_controller(renderer_controller)
+  , m_frame(nullptr)
+  , m_display_thread_abort(false)
 {
 }
 
+TileCallback::~TileCallback()
+{
+    if (m_display_thread.joinable())
+    {
+        m_display_thread_abort = true;
+        m_display_thread.join();
+    }
+}
+
 void TileCallback::release()
 {
     delete this;
@@ -147,33 +228,26 @@ void TileCallback::on_tile_begin(
     const size_t            thread_index,
     const size_t            thread_count)
 {
-    const asf::Image& image = frame->image();
-    const asf::CanvasProperties& props = image.properties();
+    const asf::CanvasProperties& props = frame->image().properties();
 
     DbgAssert(props.m_canvas_width == m_bitmap->Width());
     DbgAssert(props.m_canvas_height == m_bitmap->Height());
     DbgAssert(props.m_channel_count == 4);
 
-    const asf::Tile& tile = image.tile(tile_x, tile_y);
-    const size_t x = tile_x * props.m_tile_width;
-    const size_t y = tile_y * props.m_tile_height;
-
-    // Draw a bracket around the tile.
-    const int BracketExtent = 5;
-    BMM_Color_fl BracketColor(1.0f, 1.0f, 1.0f, 1.0f);
-    draw_bracket(
-        m_bitmap,
-        static_cast<int>(x),
-        static_cast<int>(y),
-        static_cast<int>(tile.get_width()),
-        static_cast<int>(tile.get_height()),
-        BracketExtent,
-        &BracketColor);
+    // Start the display stage when the first tile is started.
+    std::call_once(
+        m_display_initialized,
+        &TileCallback::initialize_display,
+        this,
+        std::cref(props),
+        true);
 
-    // Partially refresh the display window.
-    // Note that Bitmap::RefreshWindow() must be called from the UI thread.
-    RECT rect = make_rect(x, y, tile.get_width(), tile.get_height());
-    m_bitmap->RefreshWindow(&rect);
+    m_frame = frame;
+
+    // Let the display thread draw a bracket around the tile.
+    const size_t tile_index = tile_y * props.m_tile_count_x + tile_x;
+    m_tile_states[tile_index] = TileStarted;
+    m_tile_queue.push(tile_index);
 }
 
 void TileCallback::on_tile_end(
@@ -181,24 +255,17 @@ void TileCallback::on_tile_end(
     const size_t            tile_x,
     const size_t            tile_y)
 {
-    const asf::Image& image = frame->image();
-    const asf::CanvasProperties& props = image.properties();
-
-    DbgAssert(props.m_canvas_width == m_bitmap->Width());
-    DbgAssert(props.m_canvas_height == m_bitmap->Height());
-    DbgAssert(props.m_channel_count == 4);
-
-    const asf::Tile& tile = image.tile(tile_x, tile_y);
-    const size_t x = tile_x * props.m_tile_width;
-    const size_t y = tile_y * props.m_tile_height;
+    const asf::CanvasProperties& props = frame->image().properties();
 
-    // Blit the tile to the destination bitmap.
-    blit_tile(*frame, tile_x, tile_y);
+    // Let the display thread blit a copy of the tile, since this thread may render the tile again in the next pass.
+    snapshot_tile(*frame, tile_x, tile_y);
+    const size_t tile_index = tile_y * props.m_tile_count_x + tile_x;
+    m_tile_states[tile_index] = TileFinished;
+    m_tile_queue.push(tile_index);
 
-    // Partially refresh the display window.
-    // Note that Bitmap::RefreshWindow() must be called from the UI thread.
-    RECT rect = make_rect(x, y, tile.get_width(), tile.get_height());
-    m_bitmap->RefreshWindow(&rect);
+    // Let the renderer controller check the render budget.
+    if (m_renderer_controller != nullptr)
+        m_renderer_controller->on_tile_end(*frame, tile_x, tile_y);
 
     // Keep track of the number of rendered tiles.
     asf::atomic_inc(m_rendered_tile_count);
@@ -217,7 +284,16 @@ void TileCallback::on_progressive_frame_update(
     DbgAssert(props.m_canvas_height == m_bitmap->Height());
     DbgAssert(props.m_channel_count == 4);
 
-    // Blit all tiles.
+    // Progressive frame updates are already issued from a dedicated thread at a capped rate,
+    // they don't need a display thread.
+    std::call_once(
+        m_display_initialized,
+        &TileCallback::initialize_display,
+        this,
+        std::cref(props),
+        false);
+
+    // Blit all tiles: the progressive frame renderer develops the whole frame on every update.
     for (size_t y = 0; y < props.m_tile_count_y; ++y)
     {
         for (size_t x = 0; x < props.m_tile_count_x; ++x)
@@ -225,58 +301,291 @@ void TileCallback::on_progressive_frame_update(
     }
 
     // Refresh the entire display window.
-    // Note that Bitmap::RefreshWindow() must be called from the UI thread.
+    // Bitmap::RefreshWindow() only invalidates the window; it is repainted by the UI thread.
     m_bitmap->RefreshWindow();
 }
 
-void TileCallback::blit_tile(
+void TileCallback::initialize_display(
+    const asf::CanvasProperties&    props,
+    const bool                      start_display_thread)
+{
+    const size_t tile_count = props.m_tile_count_x * props.m_tile_count_y;
+
+    m_row_buffer.resize(props.m_tile_width);
+    m_dirty_tiles.assign(tile_count, false);
+
+    m_tile_states.reset(new std::atomic<std::uint32_t>[tile_count]);
+    for (size_t i = 0; i < tile_count; ++i)
+        m_tile_states[i] = TileIdle;
+
+    m_tile_queue.resize(tile_count);
+
+    if (start_display_thread)
+    {
+        m_tile_snapshots.reset(new TileSnapshot[tile_count]);
+        for (size_t y = 0; y < props.m_tile_count_y; ++y)
+        {
+            for (size_t x = 0; x < props.m_tile_count_x; ++x)
+            {
+                const size_t width = std::min(props.m_tile_width, props.m_canvas_width - x * props.m_tile_width);
+                const size_t height = std::min(props.m_tile_height, props.m_canvas_height - y * props.m_tile_height);
+                TileSnapshot& snapshot = m_tile_snapshots[y * props.m_tile_count_x + x];
+                snapshot.m_width = width;
+                snapshot.m_pixels.resize(width * height);
+            }
+        }
+
+        m_display_thread = std::thread(&TileCallback::display_thread, this);
+    }
+}
+
+void TileCallback::display_thread()
+{
+    // Cap the refresh rate of the display window.
+    const std::chrono::milliseconds RefreshInterval(50);
+
+    while (!m_display_thread_abort)
+    {
+        std::this_thread::sleep_for(RefreshInterval);
+        update_display();
+    }
+
+    // Display the final state of all tiles.
+    update_display();
+}
+
+void TileCallback::update_display()
+{
+    const asr::Frame* frame = m_frame;
+    if (frame == nullptr)
+        return;
+
+    const asf::Image& image = frame->image();
+    const asf::CanvasProperties& props = image.properties();
+
+    // Apply the latest state of all queued tiles.
+    size_t dirty_tile_count = 0;
+    size_t tile_index;
+    while (m_tile_queue.pop(tile_index))
+    {
+        const size_t tile_x = tile_index % props.m_tile_count_x;
+        const size_t tile_y = tile_index / props.m_tile_count_x;
+
+        switch (m_tile_states[tile_index].exchange(TileIdle))
+        {
+          case TileStarted:
+            {
+                // Draw a bracket around the tile.
+                const int BracketExtent = 5;
+                BMM_Color_fl BracketColor(1.0f, 1.0f, 1.0f, 1.0f);
+                const asf::Tile& tile = image.tile(tile_x, tile_y);
+                draw_bracket(
+                    m_bitmap,
+                    static_cast<int>(tile_x * props.m_tile_width),
+                    static_cast<int>(tile_y * props.m_tile_height),
+                    static_cast<int>(tile.get_width()),
+                    static_cast<int>(tile.get_height()),
+                    BracketExtent,
+                    &BracketColor);
+            }
+            break;
+
+          case TileFinished:
+            blit_snapshot(props, tile_x, tile_y);
+            break;
+
+          default:
+            continue;
+        }
+
+        if (!m_dirty_tiles[tile_index])
+        {
+            m_dirty_tiles[tile_index] = true;
+            ++dirty_tile_count;
+        }
+    }
+
+    if (dirty_tile_count == 0)
+        return;
+
+    // Partially refresh the display window.
+    // Bitmap::RefreshWindow() only invalidates the window; it is repainted by the UI thread.
+    // The UI thread is blocked in Render() during final renders, so this can't be posted to it.
+    for (RECT& rect : merge_dirty_tiles(props, m_dirty_tiles))
+        m_bitmap->RefreshWindow(&rect);
+
+    m_dirty_tiles.assign(m_dirty_tiles.size(), false);
+}
+
+void TileCallback::snapshot_tile(
     const asr::Frame&       frame,
     const size_t            tile_x,
     const size_t            tile_y)
 {
     const asf::CanvasProperties& props = frame.image().properties();
+    const asf::Tile& tile = frame.image().tile(tile_x, tile_y);
+    const size_t tile_width = tile.get_width();
+    const size_t tile_height = tile.get_height();
+    const size_t row_size = tile_width * tile.get_pixel_size();
+
+    TileSnapshot& snapshot = m_tile_snapshots[tile_y * props.m_tile_count_x + tile_x];
+    DbgAssert(snapshot.m_pixels.size() == tile_width * tile_height);
 
-    // Allocate memory for the temporary tile.
-    if (m_float_tile_storage.get() == nullptr)
+    std::lock_guard<std::mutex> lock(snapshot.m_mutex);
+
+    for (size_t y = 0; y < tile_height; ++y)
     {
-        m_float_tile_storage.reset(
-            new asf::Tile(
-                props.m_tile_width,
-                props.m_tile_height,
-                props.m_channel_count,
-                asf::PixelFormatFloat));
+        const std::uint8_t* src = tile.pixel(0, y);
+
+        asf::Pixel::convert_from_format<float>(
+            tile.get_pixel_format(),
+            src,
+            src + row_size,
+            1,
+            reinterpret_cast<float*>(&snapshot.m_pixels[y * tile_width]),
+            1);
     }
+}
 
-    // Retrieve the source tile.
-    const asf::Tile& tile = frame.image().tile(tile_x, tile_y);
+void TileCallback::blit_snapshot(
+    const asf::CanvasProperties& props,
+    const size_t            tile_x,
+    const size_t            tile_y)
+{
+    TileSnapshot& snapshot = m_tile_snapshots[tile_y * props.m_tile_count_x + tile_x];
+    const int dest_x = static_cast<int>(tile_x * props.m_tile_width);
+    const int dest_y = static_cast<int>(tile_y * props.m_tile_height);
+    const size_t tile_height = snapshot.m_pixels.size() / snapshot.m_width;
+
+    std::lock_guard<std::mutex> lock(snapshot.m_mutex);
 
-    // Convert the tile to 32-bit floating point.
-    asf::Tile fp_tile(
-        tile,
-        asf::PixelFormatFloat,
-        m_float_tile_storage->get_storage());
-
-    // Blit the time into the bitmap.
-    const size_t dest_x = tile_x * props.m_tile_width;
-    const size_t dest_y = tile_y * props.m_tile_height;
-    const size_t tile_width = fp_tile.get_width();
-    const size_t tile_height = fp_tile.get_height();
     for (size_t y = 0; y < tile_height; ++y)
     {
-        for (size_t x = 0; x < tile_width; ++x)
-        {
-            static_assert(
-                sizeof(BMM_Color_fl) == sizeof(asf::Color4f),
-                "BMM_Color_fl is expected to be the same size of foundation::Color4f");
+        m_bitmap->PutPixels(
+            dest_x,
+            dest_y + static_cast<int>(y),
+            static_cast<int>(snapshot.m_width),
+            reinterpret_cast<BMM_Color_fl*>(&snapshot.m_pixels[y * snapshot.m_width]));
+    }
+}
 
-            asf::Color4f color;
-            fp_tile.get_pixel(x, y, color);
+void TileCallback::blit_tile(
+    const asr::Frame&       frame,
+    const size_t            tile_x,
+    const size_t            tile_y)
+{
+    static_assert(
+        sizeof(BMM_Color_fl) == sizeof(asf::Color4f),
+        "BMM_Color_fl is expected to be the same size of foundation::Color4f");
+
+    const asf::CanvasProperties& props = frame.image().properties();
+
+    // Retrieve the source tile.
+    const asf::Tile& tile = frame.image().tile(tile_x, tile_y);
+    const size_t tile_width = tile.get_width();
+    const size_t tile_height = tile.get_height();
+
+    DbgAssert(tile.get_channel_count() == 4);
+
+    // Blit the tile into the bitmap, one row at a time.
+    const int dest_x = static_cast<int>(tile_x * props.m_tile_width);
+    const int dest_y = static_cast<int>(tile_y * props.m_tile_height);
 
+    if (tile.get_pixel_format() == asf::PixelFormatFloat)
+    {
+        // Rows of 32-bit floating point RGBA pixels already have the memory layout of BMM_Color_fl rows.
+        for (size_t y = 0; y < tile_height; ++y)
+        {
             m_bitmap->PutPixels(
-                static_cast<int>(dest_x + x),
-                static_cast<int>(dest_y + y),
-                1,
-                reinterpret_cast<BMM_Color_fl*>(&color));
+                dest_x,
+                dest_y + static_cast<int>(y),
+                static_cast<int>(tile_width),
+                reinterpret_cast<BMM_Color_fl*>(const_cast<std::uint8_t*>(tile.pixel(0, y))));
         }
     }
+    else
+    {
+        // Convert rows to 32-bit floating point into the row buffer, then blit them.
+        blit_converted_rows(
+            tile,
+            dest_x,
+            dest_y,
+            reinterpret_cast<BMM_Color_fl*>(&m_row_buffer[0]));
+    }
+}
+
+void TileCallback::blit_converted_rows(
+    const asf::Tile&        tile,
+    const int               dest_x,
+    const int               dest_y,
+    BMM_Color_fl*           row)
+{
+    const size_t tile_width = tile.get_width();
+    const size_t tile_height = tile.get_height();
+    const size_t row_size = tile_width * tile.get_pixel_size();
+
+    for (size_t y = 0; y < tile_height; ++y)
+    {
+        const std::uint8_t* src = tile.pixel(0, y);
+
+        asf::Pixel::convert_from_format<float>(
+            tile.get_pixel_format(),
+            src,
+            src + row_size,
+            1,
+            reinterpret_cast<float*>(row),
+            1);
+
+        m_bitmap->PutPixels(dest_x, dest_y + static_cast<int>(y), static_cast<int>(tile_width), row);
+    }
+}
+
+
+//
+// TileCallback::TileQueue class implementation.
+//
+
+void TileCallback::TileQueue::resize(const size_t tile_count)
+{
+    // Since a tile is never queued twice, the queue can't hold more than `tile_count` entries.
+    m_capacity = tile_count;
+    m_queued.reset(new std::atomic<bool>[tile_count]);
+    m_slots.reset(new std::atomic<size_t>[tile_count]);
+
+    for (size_t i = 0; i < tile_count; ++i)
+    {
+        m_queued[i] = false;
+        m_slots[i] = 0;
+    }
+
+    m_tail = 0;
+    m_head = 0;
+}
+
+void TileCallback::TileQueue::push(const size_t tile_index)
+{
+    if (m_queued[tile_index].exchange(true))
+        return;
+
+    const size_t slot = m_tail.fetch_add(1) % m_capacity;
+    m_slots[slot].store(tile_index + 1, std::memory_order_release);
+}
+
+bool TileCallback::TileQueue::pop(size_t& tile_index)
+{
+    std::atomic<size_t>& slot = m_slots[m_head % m_capacity];
+
+    // An empty slot means the queue is empty, or that a producer is about to fill it.
+    const size_t value = slot.load(std::memory_order_acquire);
+    if (value == 0)
+        return false;
+
+    slot.store(0, std::memory_order_relaxed);
+    ++m_head;
+
+    // Allow the tile to be queued again before its state is read by the consumer.
+    tile_index = value - 1;
+    m_queued[tile_index] = false;
+
+    return true;
 }
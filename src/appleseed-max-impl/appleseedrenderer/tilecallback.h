@@ -35,16 +35,24 @@
 #include "renderer/api/rendering.h"
 
 // appleseed.foundation headers.
+#include "foundation/image/color.h"
 #include "foundation/image/tile.h"
 
 // Standard headers.
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 // Forward declarations.
-namespace renderer  { class Frame; }
+namespace foundation    { class CanvasProperties; }
+namespace renderer      { class Frame; }
 class Bitmap;
+class BMM_Color_fl;
+class RendererController;
 
 class TileCallback
   : public renderer::TileCallbackBase
@@ -52,7 +60,10 @@ class TileCallback
   public:
     TileCallback(
         Bitmap*                         bitmap,
-        volatile std::uint32_t*         rendered_tile_count);
+        volatile std::uint32_t*         rendered_tile_count,
+        RendererController*             renderer_controller = nullptr);
+
+    ~TileCallback() override;
 
     void release() override;
 
@@ -76,12 +87,86 @@ class TileCallback
         const std::uint64_t             samples_per_second) override;
 
   private:
+    // Bounded lock-free multiple-producer single-consumer queue of tile indices.
+    // A tile that is already in the queue is not queued a second time.
+    class TileQueue
+    {
+      public:
+        // Not thread-safe.
+        void resize(const size_t tile_count);
+
+        // Can be called concurrently from any number of threads. Never blocks.
+        void push(const size_t tile_index);
+
+        // Must only be called from a single thread. Return false if the queue is empty.
+        bool pop(size_t& tile_index);
+
+      private:
+        std::unique_ptr<std::atomic<bool>[]>        m_queued;
+        std::unique_ptr<std::atomic<size_t>[]>      m_slots;    // tile index + 1, or 0 if the slot is empty
+        size_t                                      m_capacity = 0;
+        std::atomic<size_t>                         m_tail{0};
+        size_t                                      m_head = 0;
+    };
+
+    // Copy of a rendered tile in 32-bit floating point RGBA, written by the render thread that rendered
+    // the tile and read by the display thread, so that the display never reads tiles being rendered.
+    struct TileSnapshot
+    {
+        std::mutex                      m_mutex;
+        size_t                          m_width = 0;
+        std::vector<foundation::Color4f> m_pixels;
+    };
+
+    enum TileState : std::uint32_t
+    {
+        TileIdle,
+        TileStarted,
+        TileFinished
+    };
+
     Bitmap*                             m_bitmap;
     volatile std::uint32_t*             m_rendered_tile_count;
-    std::unique_ptr<foundation::Tile>   m_float_tile_storage;
+    RendererController*                 m_renderer_controller;
+    std::vector<bool>                   m_dirty_tiles;
+    std::vector<foundation::Color4f>    m_row_buffer;           // scratch memory of progressive updates, which are issued from a single thread
+
+    // Display stage: render threads only record tile state changes, the display thread
+    // applies them to the bitmap at a capped refresh rate.
+    std::once_flag                      m_display_initialized;
+    std::atomic<const renderer::Frame*> m_frame;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> m_tile_states;
+    std::unique_ptr<TileSnapshot[]>     m_tile_snapshots;
+    TileQueue                           m_tile_queue;
+    std::thread                         m_display_thread;
+    std::atomic<bool>                   m_display_thread_abort;
+
+    void initialize_display(
+        const foundation::CanvasProperties& props,
+        const bool                      start_display_thread);
+
+    void display_thread();
+
+    void update_display();
+
+    void snapshot_tile(
+        const renderer::Frame&          frame,
+        const size_t                    tile_x,
+        const size_t                    tile_y);
+
+    void blit_snapshot(
+        const foundation::CanvasProperties& props,
+        const size_t                    tile_x,
+        const size_t                    tile_y);
 
     void blit_tile(
         const renderer::Frame&          frame,
         const size_t                    tile_x,
         const size_t                    tile_y);
+
+    void blit_converted_rows(
+        const foundation::Tile&         tile,
+        const int                       dest_x,
+        const int                       dest_y,
+        BMM_Color_fl*                   row);
 };
@@ -69,6 +69,9 @@
 
 // Standard headers.
 #include <cstdint>
+#include <iomanip>
+#include <map>
+#include <sstream>
 
 namespace asf = foundation;
 namespace asr = renderer;
@@ -268,6 +271,22 @@ bool is_linear_texture(BitmapTex* bitmap_tex)
         asf::ends_with(filepath, ".hdr");
 }
 
+void load_map_files_recursively(MtlBase* mtl_base, const TimeValue time)
+{
+    if (IsTex(mtl_base))
+    {
+        Texmap* tex_map = static_cast<Texmap*>(mtl_base);
+        tex_map->LoadMapFiles(time);
+    }
+
+    for (int i = 0, e = mtl_base->NumSubTexmaps(); i < e; i++)
+    {
+        Texmap* sub_tex = mtl_base->GetSubTexmap(i);
+        if (sub_tex != nullptr)
+            load_map_files_recursively(sub_tex, time);
+    }
+}
+
 asf::auto_release_ptr<asf::Image> render_bitmap_to_image(
     Bitmap*                 bitmap,
     const size_t            image_width,
@@ -352,6 +371,35 @@ std::string insert_texture_and_instance(
     return std::string();
 }
 
+namespace
+{
+    std::string get_file_stem(const std::string& filepath)
+    {
+        const size_t separator = filepath.find_last_of("/\\");
+        const std::string filename =
+            separator == std::string::npos ? filepath : filepath.substr(separator + 1);
+        return filename.substr(0, filename.find_last_of('.'));
+    }
+
+    // Return a name made of a base name followed by a hash of a set of parameters.
+    std::string make_parameterized_name(const std::string& base_name, const asr::ParamArray& params)
+    {
+        // Sort parameters by name so that the hash doesn't depend on insertion order.
+        std::map<std::string, std::string> sorted_params;
+        for (auto i = params.strings().begin(), e = params.strings().end(); i != e; ++i)
+            sorted_params[i.key()] = i.value();
+
+        std::string key;
+        for (const auto& param : sorted_params)
+            key += param.first + '=' + param.second + ';';
+
+        std::stringstream sstr;
+        sstr << base_name << '_';
+        sstr << std::hex << std::setw(16) << std::setfill('0') << asf::siphash24(key.data(), key.size());
+        return sstr.str();
+    }
+}
+
 std::string insert_bitmap_texture_and_instance(
     asr::BaseGroup&         base_group,
     BitmapTex*              bitmap_tex,
@@ -369,7 +417,21 @@ std::string insert_bitmap_texture_and_instance(
         else texture_params.insert("color_space", "srgb");
     }
 
-    const std::string texture_name = wide_to_utf8(bitmap_tex->GetName());
+    if (!texture_instance_params.strings().exist("filtering_mode"))
+    {
+        if (bitmap_tex->GetFilterType() == FILTER_NADA)
+            texture_instance_params.insert("filtering_mode", "nearest");
+        else texture_instance_params.insert("filtering_mode", "bilinear");
+    }
+
+    // Textures are named after their parameters (which include the file path) rather than after the map:
+    // all maps referencing the same file with the same settings share a single texture, while maps with
+    // the same name but different files or settings no longer collide.
+    std::string base_name = get_file_stem(filepath);
+    if (base_name.empty())
+        base_name = wide_to_utf8(bitmap_tex->GetName());
+
+    const std::string texture_name = make_parameterized_name(base_name, texture_params);
     if (base_group.textures().get_by_name(texture_name.c_str()) == nullptr)
     {
         base_group.textures().insert(
@@ -379,7 +441,8 @@ std::string insert_bitmap_texture_and_instance(
                 asf::SearchPaths()));
     }
 
-    const std::string texture_instance_name = texture_name + "_inst";
+    const std::string texture_instance_name =
+        make_parameterized_name(texture_name, texture_instance_params) + "_inst";
     if (base_group.texture_instances().get_by_name(texture_instance_name.c_str()) == nullptr)
     {
         base_group.texture_instances().insert(
@@ -754,22 +817,6 @@ namespace
         Texmap*                 m_texmap;
         TimeValue               m_time;
     };
-
-    void load_map_files_recursively(MtlBase* mat_base, TimeValue time)
-    {
-        if (IsTex(mat_base))
-        {
-            Texmap* tex_map = static_cast<Texmap*>(mat_base);
-            tex_map->LoadMapFiles(time);
-        }
-
-        for (int i = 0, e = mat_base->NumSubTexmaps(); i < e; i++)
-        {
-            Texmap* sub_tex = mat_base->GetSubTexmap(i);
-            if (sub_tex != nullptr)
-                load_map_files_recursively(sub_tex, time);
-        }
-    }
 }
 
 std::string insert_procedural_texture_and_instance(
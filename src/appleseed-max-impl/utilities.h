@@ -65,6 +65,7 @@ class Bitmap;
 class BitmapTex;
 class Color;
 class IParamMap2;
+class MtlBase;
 class Texmap;
 
 
@@ -85,6 +86,9 @@ bool is_supported_procedural_texture(Texmap* map, const bool use_max_procedural_
 
 bool is_linear_texture(BitmapTex* bitmap_tex);
 
+// Load the bitmap files of a material or map and of all its sub-maps.
+void load_map_files_recursively(MtlBase* mtl_base, const TimeValue time);
+
 // Render a Max bitmap to a tiled 32-bit floating point RGBA appleseed image.
 foundation::auto_release_ptr<foundation::Image> render_bitmap_to_image(
     Bitmap*                     bitmap,